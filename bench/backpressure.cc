@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/pipeline.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct stop_on_read
+{
+    listener* l = nullptr;
+    expect<> on_read(ifd&) { return l->shutdown(); }
+};
+
+}
+
+
+/*!
+ * \brief backpressure - memory held by a pipeline whose worker is slower than its connection, with and without watermarks.
+ *
+ *     iolistener_bench backpressure [mib=64] [high_kib=0] [cost_ns_per_kib=2000]
+ *
+ *     A writer thread pushes mib MiB into one connection as fast as the socket takes them; the pipeline worker costs
+ *     cost_ns_per_kib. Without watermarks (high_kib=0) the listener reads everything into the pool; with them the
+ *     reads pause at high_kib of buffers held (resume at half of it) and the writer blocks on the full socket instead.
+ */
+int backpressure(int argc, char** argv)
+{
+    auto total = static_cast<std::size_t>(arg(argc, argv, 1, 64)) * 1024 * 1024;
+    auto high  = static_cast<std::size_t>(arg(argc, argv, 2, 0)) * 1024;
+    auto cost  = static_cast<uint64_t>(arg(argc, argv, 3, 2000));
+
+    std::atomic<std::size_t> processed{0};
+    listener l(nullptr, -1);
+    io::pipeline p(nullptr, [&](io::pipeline::item& it){
+        auto until = now_ns() + cost * it.size / 1024;
+        while(now_ns() < until);
+        processed += it.size;
+        it.size = 0; // no response.
+    }, 1);
+    if(!p.attach(l)) return 1;
+
+    int sv[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 1;
+    if(!p.add(sv[0], high, high / 2)) return 1;
+
+    std::size_t peak = 0;
+    std::thread writer([&]{
+        std::vector<char> block(64 * 1024, 'b');
+        std::size_t sent = 0;
+        while(sent < total)
+        {
+            auto n = ::write(sv[1], block.data(), std::min(block.size(), total - sent));
+            if(n <= 0) break;
+            sent += n;
+        }
+    });
+    int stop[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, stop) < 0) return 1;
+    stop_on_read s{&l};
+    (void)l.add_ifd(stop[0], ifd::O_READ);
+    l.query_fd(stop[0])->read_signal().connect(&s, &stop_on_read::on_read);
+    std::thread loop([&]{ (void)l.run(); });
+
+    auto t0 = now_ns();
+    while(processed < total)
+    {
+        peak = std::max(peak, p.memory());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto elapsed = now_ns() - t0;
+    writer.join();
+    (void)::write(stop[1], "x", 1);
+    loop.join();
+    p.stop();
+    for(int fd : {sv[0], sv[1], stop[0], stop[1]}) ::close(fd);
+
+    std::cout << "  high " << high / 1024 << " KiB: " << total / (1024 * 1024) << " MiB processed in " << elapsed / 1000000.0
+              << " ms, buffer pool " << p.memory() / 1024 << " KiB (peak seen " << peak / 1024 << " KiB)\n";
+    return 0;
+}
+
+}
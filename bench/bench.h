@@ -0,0 +1,74 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+/*!
+ * \brief iolistener_bench - performance measurements of the iolistener components.
+ *
+ *     Each measurement is a sub-command : iolistener_bench <name> [args...]
+ */
+namespace io::bench
+{
+
+using clock = std::chrono::steady_clock;
+
+inline uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * \brief arg returns argv[n] as a number, or \a def if absent.
+ */
+inline long arg(int argc, char** argv, int n, long def)
+{
+    return n < argc ? std::strtol(argv[n], nullptr, 10) : def;
+}
+
+/*!
+ * \brief percentile of an already sorted sample vector.
+ */
+inline uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if(sorted.empty()) return 0;
+    auto x = static_cast<std::size_t>(p * (sorted.size() - 1));
+    return sorted[x];
+}
+
+int memory(int argc, char** argv);
+int dispatch(int argc, char** argv);
+int churn(int argc, char** argv);
+int udp(int argc, char** argv);
+int pingpong(int argc, char** argv);
+int replay(int argc, char** argv);
+int fairness(int argc, char** argv);
+int pipeline(int argc, char** argv);
+int shm(int argc, char** argv);
+int backpressure(int argc, char** argv);
+int tail(int argc, char** argv);
+int processes(int argc, char** argv);
+int sim(int argc, char** argv);
+int rpc(int argc, char** argv);
+int broadcast(int argc, char** argv);
+int numa(int argc, char** argv);
+
+}
@@ -0,0 +1,224 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/broadcaster.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief drain reads the subscriber ends until \a expected bytes came in, then writes to \a done (if >= 0).
+ */
+void drain(const std::vector<int>& fds, uint64_t expected, int done)
+{
+    int ep = epoll_create1(0);
+    for(auto fd : fds)
+    {
+        epoll_event e{};
+        e.events = EPOLLIN;
+        e.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &e);
+    }
+    std::vector<epoll_event> ev(256);
+    char buf[64 * 1024];
+    uint64_t got = 0;
+    while(got < expected)
+    {
+        int n = epoll_wait(ep, ev.data(), static_cast<int>(ev.size()), 1000);
+        if(n <= 0) break;
+        for(int x = 0; x < n; x++)
+        {
+            auto r = ::read(ev[x].data.fd, buf, sizeof(buf));
+            if(r > 0) got += static_cast<uint64_t>(r);
+        }
+    }
+    ::close(ep);
+    if(done >= 0) (void)::write(done, "x", 1);
+}
+
+
+/*!
+ * \brief publisher - publishes a batch of messages per ring of its eventfd, rings it again until all are out.
+ */
+struct publisher
+{
+    listener* l = nullptr;
+    broadcaster* b = nullptr;
+    int efd = -1;
+    long messages = 0, size = 0, batch = 64, next = 0;
+    uint64_t publish_ns = 0;
+
+    expect<> on_tick(ifd&)
+    {
+        uint64_t v;
+        (void)::read(efd, &v, sizeof(v));
+        auto t0 = now_ns();
+        for(long x = 0; x < batch && next < messages; x++, next++)
+        {
+            shared_buffer m(static_cast<std::size_t>(size));
+            std::memset(m.wdata(), static_cast<int>(next & 0xff), m.size());
+            (void)b->publish(m, static_cast<uint32_t>(next % 16) + 1); // 16 instruments.
+        }
+        publish_ns += now_ns() - t0;
+        if(next < messages)
+        {
+            v = 1;
+            (void)::write(efd, &v, sizeof(v));
+        }
+        return rem::ok;
+    }
+};
+
+struct stop_on_read
+{
+    listener* l = nullptr;
+    expect<> on_read(ifd&) { return l->shutdown(); }
+};
+
+
+void report(const char* what, long subs, long messages, long size, uint64_t ns, uint64_t publish_ns)
+{
+    auto bytes = static_cast<double>(subs) * messages * size;
+    std::cout << "  " << what << ": " << ns / 1000000.0 << " ms, " << bytes / (1024.0 * 1024.0) * 1e9 / static_cast<double>(ns)
+              << " MiB/s to the subscribers; publishing "
+              << static_cast<double>(publish_ns) / static_cast<double>(messages) / 1000.0 << " usec/message ("
+              << static_cast<double>(publish_ns) / static_cast<double>(messages) / static_cast<double>(subs) << " ns/subscriber)\n";
+}
+
+}
+
+
+/*!
+ * \brief broadcast - one publisher, many subscribers: application copies and blocking writes, against the broadcaster.
+ *
+ *     iolistener_bench broadcast [subscribers=1000] [messages=2000] [size=256] [policy=0]
+ *
+ *     A thread drains the subscribers' ends. The broadcaster run has one more subscriber that never reads - policy 0:
+ *     disconnect, 1: drop_oldest, 2: conflate (16 keys). The copy run cannot have it: its blocking write would stall the
+ *     publisher for good.
+ */
+int broadcast(int argc, char** argv)
+{
+    auto subs = arg(argc, argv, 1, 1000);
+    auto messages = arg(argc, argv, 2, 2000);
+    auto size = arg(argc, argv, 3, 256);
+    auto pol = arg(argc, argv, 4, 0);
+    auto expected = static_cast<uint64_t>(subs) * messages * size;
+
+    {
+        std::vector<int> w, r;
+        for(long x = 0; x < subs; x++)
+        {
+            int sv[2];
+            if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 1;
+            w.push_back(sv[0]);
+            r.push_back(sv[1]);
+        }
+        std::thread reader(drain, std::cref(r), expected, -1);
+        std::vector<uint8_t> msg(static_cast<std::size_t>(size));
+        auto t0 = now_ns();
+        for(long m = 0; m < messages; m++)
+        {
+            std::memset(msg.data(), static_cast<int>(m & 0xff), msg.size());
+            for(auto fd : w)
+            {
+                ifd f(fd, ifd::O_WRITE);
+                std::vector<uint8_t> copy(msg); // the per-subscriber copy of the application.
+                (void)f.out(copy.data(), copy.size(), true);
+            }
+        }
+        auto ns = now_ns() - t0;
+        reader.join();
+        report("copy + ifd::out  ", subs, messages, size, now_ns() - t0, ns);
+        for(auto fd : w) ::close(fd);
+        for(auto fd : r) ::close(fd);
+    }
+
+    listener l(nullptr, -1);
+    broadcaster::limits lim;
+    // Over one publish batch - the others never reach it - and reached by the slow subscriber.
+    lim.max_messages = static_cast<std::size_t>(std::clamp(messages / 4, publisher{}.batch, 256L));
+    lim.slow = static_cast<broadcaster::policy>(pol);
+    broadcaster b(nullptr, "bench::broadcaster", l, lim);
+
+    std::vector<int> w, r;
+    for(long x = 0; x <= subs; x++)
+    {
+        int sv[2];
+        if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) return 1;
+        if(x == subs)
+        {
+            // The slow one: its socket fills up after a few messages, then its queue.
+            int small = 4096;
+            setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+            setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        }
+        w.push_back(sv[0]);
+        r.push_back(sv[1]);
+        (void)b.subscribe(sv[0]);
+    }
+    int slow = r.back(); // never read.
+    r.pop_back();
+    int stop[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, stop) < 0) return 1;
+    stop_on_read s{&l};
+    (void)l.add_ifd(stop[0], ifd::O_READ);
+    l.query_fd(stop[0])->read_signal().connect(&s, &stop_on_read::on_read);
+
+    publisher p;
+    p.l = &l;
+    p.b = &b;
+    p.messages = messages;
+    p.size = size;
+    p.efd = eventfd(1, EFD_NONBLOCK);
+    (void)l.add_ifd(p.efd, ifd::O_READ | ifd::O_MSG);
+    l.query_fd(p.efd)->read_signal().connect(&p, &publisher::on_tick);
+
+    std::thread reader(drain, std::cref(r), expected, stop[1]);
+    auto t0 = now_ns();
+    (void)l.run();
+    auto ns = now_ns() - t0;
+    reader.join();
+
+    static const char* names[] = {"disconnect", "drop_oldest", "conflate"};
+    report("broadcaster      ", subs, messages, size, ns, p.publish_ns);
+    auto const& st = b.statistics();
+    std::cout << "  policy " << names[pol % 3] << ": " << static_cast<double>(st.syscalls) / static_cast<double>(subs)
+              << " sends/subscriber for " << messages << " messages; slow subscriber "
+              << (!b.subscribed(w.back()) ? std::string("disconnected") : "queued " + std::to_string(b.queued(w.back())) + " messages")
+              << ", " << st.dropped << " dropped, " << st.conflated << " conflated, " << st.disconnected << " disconnected, "
+              << st.overrun << " overrun\n";
+    uint64_t applied[] = {st.disconnected, st.dropped, st.conflated};
+    bool failed = !applied[pol % 3];
+    if(failed) std::cerr << "  FAILED: the slow subscriber never went over the limits - policy " << names[pol % 3] << " not applied\n";
+    for(auto fd : w) ::close(fd);
+    for(auto fd : r) ::close(fd);
+    for(int fd : {slow, stop[0], stop[1], p.efd}) ::close(fd);
+    return failed ? 1 : 0;
+}
+
+}
@@ -0,0 +1,87 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct closer
+{
+    listener* l = nullptr;
+    long closed = 0;
+
+    rem::code on_read(ifd&) { return rem::ok; }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd& f)
+    {
+        ++closed;
+        (void)l->close_ifd(f.fd);
+    }
+    void on_idle()
+    {
+        if(!l->count()) l->shutdown();
+    }
+};
+
+}
+
+
+/*!
+ * \brief churn - teardown of many descriptors hung-up in the same batches.
+ *
+ *     iolistener_bench churn [connections=10000]
+ */
+int churn(int argc, char** argv)
+{
+    auto n = static_cast<std::size_t>(arg(argc, argv, 1, 10000));
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, 2 * n + 64);
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    n = std::min<std::size_t>(n, (rl.rlim_cur - 64) / 2);
+
+    listener l(nullptr, 0);
+    closer h;
+    h.l = &l;
+    std::vector<int> peers;
+    peers.reserve(n);
+    for(std::size_t x = 0; x < n; x++)
+    {
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) break;
+        (void)l.add_ifd(sv[0], ifd::O_READ);
+        peers.push_back(sv[1]);
+    }
+    for(int fd : peers) ::close(fd);
+
+    auto t0 = now_ns();
+    (void)l.run(h);
+    auto ns = now_ns() - t0;
+    std::cout << "  " << h.closed << " of " << peers.size() << " descriptors closed in " << ns / 1000000.0 << " ms, "
+              << (h.closed ? static_cast<double>(ns) / h.closed : 0) << " ns/descriptor\n";
+    return 0;
+}
+
+}
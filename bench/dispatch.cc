@@ -0,0 +1,157 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <sys/socket.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief signal_side - the read_signal slot. Bounces the (autofilled) bytes back through the peer.
+ */
+struct signal_side : public object
+{
+    listener* l = nullptr;
+    int peer = -1;
+    long count = 0, max = 0;
+
+    signal_side() : object(nullptr, "bench::signal_side") {}
+    expect<> on_read(ifd& f)
+    {
+        if(++count >= max) return rem::end;
+        (void)::write(peer, f.internal_buffer, f.pksize);
+        return rem::ok;
+    }
+    expect<> on_nop(ifd&) { ++count; return rem::ok; }
+};
+
+
+/*!
+ * \brief static_side - the same, as a io::handler.
+ */
+struct static_side
+{
+    int peer = -1;
+    long count = 0, max = 0;
+
+    rem::code on_read(ifd& f)
+    {
+        if(++count >= max) return rem::end;
+        (void)::write(peer, f.internal_buffer, f.pksize);
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd&) {}
+    rem::code on_nop(ifd&) { ++count; return rem::ok; }
+};
+
+static_assert(handler<static_side>);
+
+
+template<handler H> [[gnu::noinline]] rem::code static_dispatch(H& h, ifd& f)
+{
+    return h.on_nop(f);
+}
+
+
+[[gnu::noinline]] expect<> signal_dispatch(ifd& f)
+{
+    // What listener::epoll_data_in() does around ifd::data_in() around read_signal:
+    expect<> E;
+    auto R = f.read_signal()(f);
+    if(!R) return R();
+    E = R;
+    return E;
+}
+
+void report(const char* what, long n, uint64_t ns)
+{
+    std::cout << "  " << what << ": " << n << " events in " << ns / 1000000.0 << " ms, "
+              << static_cast<double>(ns) / n << " ns/event\n";
+}
+
+}
+
+
+/*!
+ * \brief dispatch - per-event dispatch cost, read_signal (book::notify) against the io::handler static form.
+ *
+ *     iolistener_bench dispatch [events=1000000]
+ *
+ *     The "call only" lines isolate the dispatch; the "loop" lines run the listener over a socketpair ping-pong,
+ *     syscalls included.
+ */
+int dispatch(int argc, char** argv)
+{
+    long n = arg(argc, argv, 1, 1000000);
+
+    {
+        ifd f(-1, 0);
+        signal_side s;
+        f.read_signal().connect(&s, &signal_side::on_nop);
+        auto t0 = now_ns();
+        for(long x = 0; x < n; x++) (void)signal_dispatch(f);
+        report("call only, read_signal ", n, now_ns() - t0);
+    }
+    {
+        ifd f(-1, 0);
+        static_side h;
+        auto t0 = now_ns();
+        for(long x = 0; x < n; x++) (void)static_dispatch(h, f);
+        report("call only, io::handler ", n, now_ns() - t0);
+    }
+
+    int sv[2];
+    long loop_n = n / 10 ? n / 10 : 1;
+    {
+        if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) return 1;
+        listener l(nullptr, -1);
+        signal_side s;
+        s.peer = sv[1];
+        s.max = loop_n;
+        (void)l.add_ifd(sv[0], ifd::O_READ | ifd::I_AUTOFILL);
+        l.query_fd(sv[0])->read_signal().connect(&s, &signal_side::on_read);
+        (void)::write(sv[1], "x", 1);
+        auto t0 = now_ns();
+        (void)l.run();
+        report("loop, read_signal      ", s.count, now_ns() - t0);
+        ::close(sv[0]);
+        ::close(sv[1]);
+    }
+    {
+        if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) return 1;
+        listener l(nullptr, -1);
+        static_side h;
+        h.peer = sv[1];
+        h.max = loop_n;
+        (void)l.add_ifd(sv[0], ifd::O_READ | ifd::I_AUTOFILL);
+        (void)::write(sv[1], "x", 1);
+        auto t0 = now_ns();
+        (void)l.run(h);
+        report("loop, io::handler      ", h.count, now_ns() - t0);
+        ::close(sv[0]);
+        ::close(sv[1]);
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <sys/socket.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief mixed - a bulk stream whose processing costs per byte, next to a small ping/echo descriptor.
+ */
+struct mixed
+{
+    listener* l = nullptr;
+    int bulk = -1;
+    uint64_t ns_per_kb = 1000;
+    uint64_t bulk_bytes = 0;
+    char buf[64 * 1024];
+
+    rem::code on_read(ifd& f)
+    {
+        if(!f.pksize) return rem::ok; // continuation - nothing carried by this handler.
+        if(f.fd != bulk)
+        {
+            auto n = ::read(f.fd, buf, 64);
+            if(n > 0) (void)::write(f.fd, buf, n);
+            return rem::ok;
+        }
+        auto left = f.pksize;
+        while(left)
+        {
+            auto n = ::read(f.fd, buf, std::min(left, sizeof(buf)));
+            if(n <= 0) break;
+            left -= n;
+            bulk_bytes += n;
+            // The work: proportional to what was taken in this dispatch.
+            auto until = now_ns() + n * ns_per_kb / 1024;
+            while(now_ns() < until);
+        }
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd& f)
+    {
+        (void)l->remove_ifd(f.fd);
+        l->shutdown();
+    }
+};
+
+}
+
+
+/*!
+ * \brief fairness - latency of a small request/response descriptor while a bulk descriptor saturates the same listener.
+ *
+ *     iolistener_bench fairness [count=20000] [budget=0] [prio=0]
+ *
+ *     A writer thread keeps the bulk socketpair full; its handler spends about 1 usec per KiB read. budget is the bulk
+ *     ifd::budget (bytes per iteration, 0 = whatever FIONREAD reports); prio=1 puts the ping descriptor in the control
+ *     class and the bulk one in the bulk class. Compare the ping percentiles with and without.
+ */
+int fairness(int argc, char** argv)
+{
+    auto count  = arg(argc, argv, 1, 20000);
+    auto budget = static_cast<uint32_t>(arg(argc, argv, 2, 0));
+    bool prio   = arg(argc, argv, 3, 0) != 0;
+
+    int bulk[2], ping[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, bulk) < 0 || ::socketpair(AF_UNIX, SOCK_STREAM, 0, ping) < 0) return 1;
+
+    listener l(nullptr, -1);
+    mixed h;
+    h.l = &l;
+    h.bulk = bulk[0];
+    (void)l.add_ifd(bulk[0], ifd::O_READ);
+    (void)l.add_ifd(ping[0], ifd::O_READ);
+    l.query_fd(bulk[0])->budget = budget;
+    if(prio)
+    {
+        l.query_fd(bulk[0])->prio = ifd::priority::bulk;
+        l.query_fd(ping[0])->prio = ifd::priority::control;
+    }
+
+    std::atomic<bool> done{false};
+    std::thread writer([&]{
+        char block[16 * 1024] = {};
+        while(!done && ::send(bulk[1], block, sizeof(block), MSG_NOSIGNAL) > 0);
+    });
+    std::thread loop([&]{ (void)l.run(h); });
+
+    std::vector<uint64_t> rtt;
+    rtt.reserve(count);
+    char msg[32] = "ping";
+    auto start = now_ns();
+    for(long x = 0; x < count; x++)
+    {
+        auto t0 = now_ns();
+        if(::write(ping[1], msg, sizeof(msg)) != sizeof(msg)) break;
+        std::size_t got = 0;
+        while(got < sizeof(msg))
+        {
+            auto n = ::read(ping[1], msg + got, sizeof(msg) - got);
+            if(n <= 0) break;
+            got += n;
+        }
+        rtt.push_back(now_ns() - t0);
+    }
+    auto elapsed = now_ns() - start;
+    done = true;
+    ::close(ping[1]);
+    loop.join();
+    ::close(bulk[1]);
+    writer.join();
+    ::close(bulk[0]);
+    ::close(ping[0]);
+
+    std::sort(rtt.begin(), rtt.end());
+    std::cout << "  budget " << budget << ", priority classes " << (prio ? "on" : "off") << ": " << rtt.size()
+              << " round trips, p50 " << percentile(rtt, 0.50) / 1000.0 << " usec, p99 " << percentile(rtt, 0.99) / 1000.0
+              << " usec, p99.9 " << percentile(rtt, 0.999) / 1000.0 << " usec\n"
+              << "  bulk: " << h.bulk_bytes / (1024.0 * 1024.0) << " MiB in " << elapsed / 1000000.0 << " ms ("
+              << (h.bulk_bytes / (1024.0 * 1024.0)) / (elapsed / 1e9) << " MiB/s)\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,65 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include <iostream>
+#include <cstring>
+
+
+namespace
+{
+
+struct entry
+{
+    const char* name;
+    int (*fn)(int, char**);
+    const char* text;
+};
+
+const entry entries[] = {
+    {"memory", io::bench::memory, "[count=100000] - bytes per registered descriptor (ifd record + handlers)"},
+    {"dispatch", io::bench::dispatch, "[events=1000000] - per-event dispatch cost, read_signal against io::handler"},
+    {"churn", io::bench::churn, "[connections=10000] - teardown of descriptors hung-up in the same batches"},
+    {"udp", io::bench::udp, "[seconds=2] [size=64] [batch=64] [gro=0] - loopback datagrams/s through udp_socket"},
+    {"pingpong", io::bench::pingpong, "[count=100000] [spin_usec=0] [cpu=-1] [so_busy_poll=0] - loopback tcp round-trip percentiles"},
+    {"replay", io::bench::replay, "[events=100000] [size=256] [path] - record a run into an io trace, replay it at full speed"},
+    {"fairness", io::bench::fairness, "[count=20000] [budget=0] [prio=0] - ping latency next to a saturating bulk descriptor"},
+    {"pipeline", io::bench::pipeline, "[workers=2] [requests=200000] [cost_usec=5] [connections=8] [depth=16] - throughput, processing inline or on workers"},
+    {"shm", io::bench::shm, "[messages=2000000] [size=64] [unix=0] - messages/s between processes, shm_channel or AF_UNIX"},
+    {"backpressure", io::bench::backpressure, "[mib=64] [high_kib=0] [cost_ns_per_kib=2000] - pipeline buffer pool with and without read watermarks"},
+    {"tail", io::bench::tail, "[files=1000] [writes=20000] [rotate_every=1000] [pace_usec=50] - file_tail pickup latency with rotations"},
+    {"process", io::bench::processes, "[children=100] [mib=4] [splice=0] - child processes output on one listener thread, read or spliced"},
+    {"sim", io::bench::sim, "[connections=1000000] [rounds=10] [size=64] [delivery=4096] [signal=0] - framed messages over the in-memory poller"},
+    {"rpc", io::bench::rpc, "[calls=200000] [window=64] [size=64] [drop=0] [timeout_ms=20] - pipelined rpc_channel calls over one loopback tcp connection"},
+    {"broadcast", io::bench::broadcast, "[subscribers=1000] [messages=2000] [size=256] [policy=0] - fan-out, per-subscriber copies and writes against the broadcaster"},
+    {"numa", io::bench::numa, "[events=200000] [cpu=0] [mib=64] [ifname=eth0] - topology, handler working set on the loop's node and on a remote one"},
+};
+
+int usage()
+{
+    std::cerr << "usage: iolistener_bench <name> [args...]\n";
+    for(auto const& e : entries)
+        std::cerr << "    " << e.name << ' ' << e.text << '\n';
+    return 1;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) return usage();
+    for(auto const& e : entries)
+        if(!std::strcmp(argv[1], e.name)) return e.fn(argc - 1, argv + 1);
+    return usage();
+}
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief legacy_ifd - the ifd record layout before the hot/cold split, kept here as the reference point.
+ */
+struct legacy_ifd
+{
+    using list = std::vector<legacy_ifd>;
+    notify<legacy_ifd&> read_signal, write_signal, idle_signal, zero_signal, window_complete_signal;
+    int fd = -1;
+    std::size_t max_pksize = 1024 * 1024;
+    uint32_t options = 0;
+    std::size_t pksize = 0, wsize = 0, wpos = 0;
+    u_int8_t* internal_buffer = nullptr;
+    struct { uint8_t active:1, destroy:1, writeable:1, readable:1; } state = {0,0,0,0};
+
+    legacy_ifd(int fd_, uint32_t opt_) : fd(fd_), options(opt_) {}
+};
+
+
+struct sink : public object
+{
+    sink() : object(nullptr, "bench::sink") {}
+    expect<> legacy_in(legacy_ifd&) { return rem::ok; }
+    expect<> data_in(ifd&) { return rem::ok; }
+};
+
+
+std::size_t heap_used()
+{
+    auto m = mallinfo2();
+    return m.uordblks + m.hblkhd; // hblkhd: the large (mmap'ed) blocks like vector storage.
+}
+
+
+void report(const char* what, std::size_t count, std::size_t bytes)
+{
+    std::cout << "  " << what << ": " << bytes << " bytes, " << (count ? bytes / count : 0) << " bytes/descriptor\n";
+}
+
+}
+
+
+/*!
+ * \brief memory - bytes per descriptor, old vector<ifd> layout against the ifd_table records.
+ *
+ *     iolistener_bench memory [count=100000]
+ */
+int memory(int argc, char** argv)
+{
+    auto count = static_cast<std::size_t>(arg(argc, argv, 1, 100000));
+    sink s;
+
+    std::cout << "sizeof(legacy ifd) = " << sizeof(legacy_ifd) << ", sizeof(ifd) = " << sizeof(ifd)
+              << ", sizeof(ifd::handlers) = " << sizeof(ifd::handlers) << '\n';
+
+    {
+        auto h0 = heap_used();
+        legacy_ifd::list l;
+        for(std::size_t x = 0; x < count; x++)
+        {
+            l.emplace_back(static_cast<int>(x), ifd::O_READ);
+            l.back().read_signal.connect(&s, &sink::legacy_in);
+        }
+        report("legacy vector<ifd>, one handler each", count, heap_used() - h0);
+    }
+    {
+        auto h0 = heap_used();
+        ifd_table t;
+        for(std::size_t x = 0; x < count; x++)
+            t.add(static_cast<int>(x), ifd::O_READ)->read_signal().connect(&s, &sink::data_in);
+        report("ifd_table, one handlers block each ", count, heap_used() - h0);
+    }
+    {
+        auto h0 = heap_used();
+        ifd_table t;
+        ifd* first = nullptr;
+        for(std::size_t x = 0; x < count; x++)
+        {
+            auto* f = t.add(static_cast<int>(x), ifd::O_READ);
+            if(!first)
+            {
+                first = f;
+                f->read_signal().connect(&s, &sink::data_in);
+            }
+            else
+                f->share_handlers(*first);
+        }
+        report("ifd_table, shared handlers block   ", count, heap_used() - h0);
+        report("ifd_table::memory_usage()          ", count, t.memory_usage());
+    }
+
+    // Real sockets registered into a listener (epoll) - needs the descriptors limit raised:
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur < count + 64)
+    {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, count + 64);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    auto nsock = std::min<std::size_t>(count, rl.rlim_cur > 64 ? rl.rlim_cur - 64 : 0);
+    {
+        listener l(nullptr, 0);
+        std::vector<int> fds;
+        fds.reserve(nsock);
+        for(std::size_t x = 0; x < nsock; x++)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if(fd < 0) break;
+            fds.push_back(fd);
+            (void)l.add_ifd(fd, ifd::O_READ);
+        }
+        report("listener, real sockets (table)     ", fds.size(), l.table().memory_usage());
+        l.shutdown();
+        for(int fd : fds) ::close(fd);
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include "iolistener/topology.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief lookup - bounces the bytes back through the peer after random reads in a working set, as a handler looking
+ * up its sessions or order books would.
+ */
+struct lookup
+{
+    int peer = -1;
+    long count = 0, max = 0;
+    const uint64_t* set = nullptr;
+    std::size_t words = 0;
+    uint64_t x = 88172645463325252ull, sum = 0;
+
+    rem::code on_read(ifd& f)
+    {
+        for(int r = 0; r < 64; r++)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            sum += set[x % words];
+        }
+        if(++count >= max) return rem::end;
+        (void)::write(peer, f.internal_buffer, f.pksize);
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd&) {}
+};
+
+static_assert(handler<lookup>);
+
+
+void run(long events, int cpu, int node, std::size_t bytes)
+{
+    int sv[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) return;
+    listener l(nullptr, -1);
+    listener::placement p;
+    p.cpu = cpu;
+    p.counters = true;
+    (void)l.set_placement(p);
+
+    auto* set = static_cast<uint64_t*>(topology::alloc(bytes, node));
+    if(!set) return;
+    for(std::size_t w = 0; w < bytes / sizeof(uint64_t); w++) set[w] = w;
+
+    lookup h;
+    h.peer = sv[1];
+    h.max = events;
+    h.set = set;
+    h.words = bytes / sizeof(uint64_t);
+    (void)l.add_ifd(sv[0], ifd::O_READ | ifd::I_AUTOFILL);
+    (void)::write(sv[1], "x", 1);
+    auto t0 = now_ns();
+    (void)l.run(h);
+    auto ns = now_ns() - t0;
+
+    auto const& st = l.stats();
+    std::cout << "  loop on cpu " << cpu << ", working set on node " << node << ": " << h.count << " events, "
+              << static_cast<double>(ns) / static_cast<double>(h.count) << " ns/event; node reads local " << st.node_local
+              << ", remote " << st.node_remote << " (checksum " << h.sum % 1000 << ")\n";
+    topology::release(set, bytes);
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+}
+
+
+/*!
+ * \brief numa - cpu/node topology, and a loop whose handler reads a working set on its own node, then on a remote one.
+ *
+ *     iolistener_bench numa [events=200000] [cpu=0] [mib=64] [ifname=eth0]
+ *
+ *     The node read counters come from perf events: zero where the cpu or the perf_event_paranoid setting does not
+ *     give them. Also shows the cpus taking the interrupts of \a ifname and the SO_INCOMING_CPU of a loopback connection.
+ */
+int numa(int argc, char** argv)
+{
+    auto events = arg(argc, argv, 1, 200000);
+    auto cpu = static_cast<int>(arg(argc, argv, 2, 0));
+    auto bytes = static_cast<std::size_t>(arg(argc, argv, 3, 64)) * 1024 * 1024;
+    std::string ifname = argc > 4 ? argv[4] : "eth0";
+
+    topology t;
+    (void)t.load();
+    std::cout << "  " << t.cpu_count() << " cpus, " << t.node_count() << " nodes:";
+    for(std::size_t n = 0; n < t.node_count(); n++)
+        std::cout << " node " << n << " [" << t.cpus(static_cast<int>(n)).size() << " cpus]";
+    std::cout << "\n  " << ifname << " interrupts on cpus:";
+    auto irq = topology::irq_cpus(ifname);
+    if(irq.empty()) std::cout << " (none found - virtual interface?)";
+    for(int c : irq) std::cout << " " << c;
+    std::cout << "\n";
+
+    {
+        int server = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(a);
+        if(::bind(server, reinterpret_cast<sockaddr*>(&a), len) == 0 && ::listen(server, 1) == 0)
+        {
+            getsockname(server, reinterpret_cast<sockaddr*>(&a), &len);
+            int c = ::socket(AF_INET, SOCK_STREAM, 0);
+            if(::connect(c, reinterpret_cast<sockaddr*>(&a), len) == 0)
+            {
+                int s = ::accept(server, nullptr, nullptr);
+                (void)::write(c, "x", 1);
+                char b;
+                (void)::read(s, &b, 1);
+                auto in = topology::incoming_cpu(s);
+                std::cout << "  loopback connection: SO_INCOMING_CPU " << (in ? *in : -1) << ", accepted on cpu "
+                          << topology::current_cpu() << "\n";
+                ::close(s);
+            }
+            ::close(c);
+        }
+        ::close(server);
+    }
+
+    auto local = t.node_of(cpu);
+    run(events, cpu, local, bytes);
+    for(std::size_t n = 0; n < t.node_count(); n++)
+        if(static_cast<int>(n) != local && !t.cpus(static_cast<int>(n)).empty())
+        {
+            run(events, cpu, static_cast<int>(n), bytes);
+            break;
+        }
+    return 0;
+}
+
+}
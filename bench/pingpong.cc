@@ -0,0 +1,135 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief echo - the server side: accepts the client then echoes what it reads.
+ */
+struct echo
+{
+    listener* l = nullptr;
+    int server = -1;
+    char buf[4096];
+
+    rem::code on_read(ifd& f)
+    {
+        if(f.fd == server)
+        {
+            int c = ::accept4(server, nullptr, nullptr, SOCK_NONBLOCK);
+            if(c >= 0)
+            {
+                int one = 1;
+                setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                (void)l->add_ifd(c, ifd::O_READ);
+            }
+            return rem::ok;
+        }
+        auto n = ::read(f.fd, buf, sizeof(buf));
+        if(n > 0) (void)::write(f.fd, buf, n);
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd& f)
+    {
+        if(f.fd != server) (void)l->close_ifd(f.fd);
+        l->shutdown();
+    }
+};
+
+}
+
+
+/*!
+ * \brief pingpong - loopback tcp round-trip latency through a listener, blocking or hybrid busy-poll.
+ *
+ *     iolistener_bench pingpong [count=100000] [spin_usec=0] [cpu=-1] [so_busy_poll=0]
+ *
+ *     The client thread sends 32 bytes and waits the echo, count times. The percentiles are the client's round trips;
+ *     the spin/sleep split is the listener's. Spinning only pays when the listener has a cpu of its own: pin it (cpu=N)
+ *     away from the client - on a single cpu the spin steals the client's time slice.
+ */
+int pingpong(int argc, char** argv)
+{
+    auto count = arg(argc, argv, 1, 100000);
+    listener::busy_poll bp;
+    bp.spin_usec    = static_cast<uint32_t>(arg(argc, argv, 2, 0));
+    bp.cpu          = static_cast<int>(arg(argc, argv, 3, -1));
+    bp.so_busy_poll = static_cast<int>(arg(argc, argv, 4, 0));
+
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(a);
+    if(::bind(server, reinterpret_cast<sockaddr*>(&a), len) < 0 || ::listen(server, 16) < 0) return 1;
+    getsockname(server, reinterpret_cast<sockaddr*>(&a), &len);
+
+    listener l(nullptr, -1);
+    (void)l.set_busy_poll(bp);
+    echo h;
+    h.l = &l;
+    h.server = server;
+    (void)l.add_ifd(server, ifd::O_READ | ifd::O_MSG); // listening socket: no FIONREAD.
+    std::thread loop([&]{ (void)l.run(h); });
+
+    int c = ::socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(::connect(c, reinterpret_cast<sockaddr*>(&a), len) < 0) return 1;
+
+    std::vector<uint64_t> rtt;
+    rtt.reserve(count);
+    char msg[32] = "ping";
+    for(long x = 0; x < count; x++)
+    {
+        auto t0 = now_ns();
+        if(::write(c, msg, sizeof(msg)) != sizeof(msg)) break;
+        std::size_t got = 0;
+        while(got < sizeof(msg))
+        {
+            auto n = ::read(c, msg + got, sizeof(msg) - got);
+            if(n <= 0) break;
+            got += n;
+        }
+        rtt.push_back(now_ns() - t0);
+    }
+    ::close(c);
+    loop.join();
+    ::close(server);
+
+    std::sort(rtt.begin(), rtt.end());
+    auto const& st = l.stats();
+    std::cout << "  spin " << bp.spin_usec << " usec: " << rtt.size() << " round trips, p50 " << percentile(rtt, 0.50) / 1000.0
+              << " usec, p99 " << percentile(rtt, 0.99) / 1000.0 << " usec, p99.9 " << percentile(rtt, 0.999) / 1000.0 << " usec\n"
+              << "  listener: spin " << st.spin_ns / 1000000.0 << " ms (" << st.spin_wakeups << " wakeups), sleep "
+              << st.sleep_ns / 1000000.0 << " ms (" << st.sleep_wakeups << " wakeups)\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/pipeline.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct stopper
+{
+    listener* l = nullptr;
+    expect<> on_read(ifd&) { return l->shutdown(); }
+};
+
+}
+
+
+/*!
+ * \brief pipeline - request throughput with the processing inline on the listener thread or on pipeline workers.
+ *
+ *     iolistener_bench pipeline [workers=2] [requests=200000] [cost_usec=5] [connections=8] [depth=16]
+ *
+ *     Each 64 bytes request costs cost_usec of cpu to the work function, which echoes it. workers=0 runs it inline.
+ *     The client thread keeps depth requests in flight on each connection.
+ */
+int pipeline(int argc, char** argv)
+{
+    auto nworkers = static_cast<std::size_t>(arg(argc, argv, 1, 2));
+    auto requests = arg(argc, argv, 2, 200000);
+    auto cost     = static_cast<uint64_t>(arg(argc, argv, 3, 5)) * 1000;
+    auto nconn    = static_cast<int>(arg(argc, argv, 4, 8));
+    auto depth    = static_cast<int>(arg(argc, argv, 5, 16));
+    constexpr std::size_t request_size = 64;
+
+    listener l(nullptr, -1);
+    io::pipeline p(nullptr, [cost](io::pipeline::item& it){
+        auto until = now_ns() + cost * it.size / request_size;
+        while(now_ns() < until);
+    }, nworkers);
+    if(!p.attach(l)) return 1;
+
+    std::vector<int> clients;
+    for(int x = 0; x < nconn; x++)
+    {
+        int sv[2];
+        if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 1;
+        (void)p.add(sv[0]);
+        clients.push_back(sv[1]);
+    }
+    int stop[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, stop) < 0) return 1;
+    stopper s{&l};
+    (void)l.add_ifd(stop[0], ifd::O_READ);
+    l.query_fd(stop[0])->read_signal().connect(&s, &stopper::on_read);
+    std::thread loop([&]{ (void)l.run(); });
+
+    char buf[request_size * 64] = {};
+    long done = 0;
+    auto t0 = now_ns();
+    while(done < requests)
+    {
+        for(int c : clients)
+            for(int d = 0; d < depth; d++)
+                (void)::write(c, buf, request_size);
+        for(int c : clients)
+        {
+            std::size_t want = request_size * depth, got = 0;
+            while(got < want)
+            {
+                auto n = ::read(c, buf, std::min(want - got, sizeof(buf)));
+                if(n <= 0) break;
+                got += n;
+            }
+        }
+        done += static_cast<long>(nconn) * depth;
+    }
+    auto elapsed = now_ns() - t0;
+    (void)::write(stop[1], "x", 1);
+    loop.join();
+    p.stop();
+    for(int c : clients) ::close(c);
+    ::close(stop[0]);
+    ::close(stop[1]);
+
+    auto const& st = p.stats();
+    std::cout << "  " << nworkers << " workers: " << done << " requests in " << elapsed / 1000000.0 << " ms, "
+              << done / (elapsed / 1e9) << " requests/s (" << st.submitted << " items, " << st.migrated << " migrations)\n";
+    return 0;
+}
+
+}
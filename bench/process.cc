@@ -0,0 +1,116 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/process.h"
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <iostream>
+#include <memory>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct supervisor
+{
+    listener* l = nullptr;
+    long      children = 0;
+    long      exited = 0;
+    long      failed = 0;
+    long      eof = 0;
+    uint64_t  bytes = 0;
+    char      buf[64 * 1024];
+
+    void done() { if(exited == children && eof == children) l->shutdown(); }
+
+    expect<> on_read(ifd& f)
+    {
+        auto left = f.pksize;
+        while(left)
+        {
+            auto n = ::read(f.fd, buf, std::min(left, sizeof(buf)));
+            if(n <= 0) break;
+            bytes += n;
+            left -= n;
+        }
+        return rem::ok;
+    }
+    expect<> on_eof(ifd&) { ++eof; done(); return rem::ok; }
+    expect<> on_exit(io::process& p)
+    {
+        ++exited;
+        if(!WIFEXITED(p.status()) || WEXITSTATUS(p.status())) ++failed;
+        done();
+        return rem::ok;
+    }
+};
+
+}
+
+
+/*!
+ * \brief processes - children driven from one listener thread: spawn cost, output throughput, read or spliced.
+ *
+ *     iolistener_bench process [children=100] [mib=4] [splice=0]
+ *
+ *     Each child is `head -c mib MiB /dev/zero`, its stdout in the listener. splice=1 forwards the output to /dev/null
+ *     with process::forward() instead of reading it.
+ */
+int processes(int argc, char** argv)
+{
+    auto children = arg(argc, argv, 1, 100);
+    auto bytes    = arg(argc, argv, 2, 4) * 1024 * 1024;
+    bool splice   = arg(argc, argv, 3, 0) != 0;
+
+    listener l(nullptr, -1);
+    supervisor s;
+    s.l = &l;
+    s.children = children;
+    int null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    std::vector<std::unique_ptr<io::process>> procs;
+    auto t0 = now_ns();
+    for(long x = 0; x < children; x++)
+    {
+        auto p = std::make_unique<io::process>(nullptr, "child");
+        if(!p->spawn(l, {"head", "-c", std::to_string(bytes), "/dev/zero"}, {}, io::process::out)) return 1;
+        auto* f = p->i_fd(io::process::out);
+        if(splice)
+            (void)p->forward(io::process::out, null);
+        else
+            f->read_signal().connect(&s, &supervisor::on_read);
+        f->zero_signal().connect(&s, &supervisor::on_eof);
+        p->exit_signal().connect(&s, &supervisor::on_exit);
+        procs.push_back(std::move(p));
+    }
+    auto spawned = now_ns() - t0;
+    (void)l.run();
+    auto elapsed = now_ns() - t0;
+    procs.clear();
+    ::close(null);
+
+    auto total = static_cast<double>(children) * bytes;
+    std::cout << "  " << children << " children (" << (splice ? "spliced" : "read") << "): spawn " << spawned / 1000.0 / children
+              << " usec/child; " << total / (1024 * 1024) << " MiB in " << elapsed / 1000000.0 << " ms, "
+              << total / (1024 * 1024) / (elapsed / 1e9) << " MiB/s; " << s.exited << " exited, " << s.failed << " failed"
+              << (splice ? "" : (", " + std::to_string(s.bytes) + " bytes read")) << "\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,115 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include <sys/socket.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief feeder - the recorded side: consumes each message and writes the next one through the peer.
+ */
+struct feeder
+{
+    int peer = -1;
+    long count = 0, max = 0;
+    std::vector<uint8_t> msg;
+
+    rem::code on_read(ifd&)
+    {
+        if(++count >= max) return rem::end;
+        (void)::write(peer, msg.data(), msg.size());
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd&) {}
+};
+
+
+/*!
+ * \brief checksum - the replayed handler under measure.
+ */
+struct checksum : public object
+{
+    uint64_t sum = 0, bytes = 0;
+
+    checksum() : object(nullptr, "bench::checksum") {}
+    expect<> on_read(ifd& f)
+    {
+        for(std::size_t x = 0; x < f.pksize; x++) sum = sum * 31 + f.internal_buffer[x];
+        bytes += f.pksize;
+        return rem::ok;
+    }
+};
+
+}
+
+
+/*!
+ * \brief replay - records a socketpair run into a trace, then replays it through a read_signal handler at full speed.
+ *
+ *     iolistener_bench replay [events=100000] [size=256] [path=/tmp/iolistener.trace]
+ */
+int replay(int argc, char** argv)
+{
+    auto n    = arg(argc, argv, 1, 100000);
+    auto size = static_cast<std::size_t>(arg(argc, argv, 2, 256));
+    std::string path = argc > 3 ? argv[3] : "/tmp/iolistener.trace";
+
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) return 1;
+    int fd = sv[0];
+    {
+        trace_writer tw;
+        if(!tw.open(path)) return 1;
+        listener l(nullptr, -1);
+        l.set_trace(&tw);
+        feeder h;
+        h.peer = sv[1];
+        h.max = n;
+        h.msg.assign(size, 'r');
+        (void)l.add_ifd(fd, ifd::O_READ | ifd::I_AUTOFILL);
+        (void)::write(sv[1], h.msg.data(), size);
+        auto t0 = now_ns();
+        (void)l.run(h);
+        auto ns = now_ns() - t0;
+        std::cout << "  recorded " << tw.records() << " events, " << tw.size() << " bytes in " << ns / 1000000.0 << " ms\n";
+        (void)tw.close();
+    }
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    trace_replay tr;
+    if(!tr.open(path)) return 1;
+    checksum c;
+    tr.add(fd)->read_signal().connect(&c, &checksum::on_read);
+    auto t0 = now_ns();
+    auto P = tr.play();
+    auto ns = now_ns() - t0;
+    if(!P) return 1;
+    std::cout << "  replayed " << *P << " events, " << c.bytes << " bytes in " << ns / 1000000.0 << " ms: "
+              << static_cast<uint64_t>(*P * 1e9 / ns) << " events/s, "
+              << c.bytes * 1e3 / ns << " MB/s (checksum " << c.sum << ")\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/rpc_channel.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <functional>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief tcp_pair a connected loopback tcp connection: fds[0] the client end, fds[1] the accepted one.
+ */
+bool tcp_pair(int fds[2])
+{
+    int server = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(a);
+    if(::bind(server, reinterpret_cast<sockaddr*>(&a), len) < 0 || ::listen(server, 1) < 0) return false;
+    getsockname(server, reinterpret_cast<sockaddr*>(&a), &len);
+    fds[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(::connect(fds[0], reinterpret_cast<sockaddr*>(&a), len) < 0) return false;
+    fds[1] = ::accept(server, nullptr, nullptr);
+    ::close(server);
+    return fds[1] >= 0;
+}
+
+
+void run(long calls, long window, long size, long drop, uint32_t timeout_ms)
+{
+    int fds[2];
+    if(!tcp_pair(fds)) return;
+    listener l(nullptr, -1);
+    rpc_channel client(nullptr, "bench::client"), server(nullptr, "bench::server");
+    if(!client.attach(l, fds[0]) || !server.attach(l, fds[1])) return;
+
+    long requests = 0;
+    server.serve([&](rpc_channel& ch, const rpc_channel::message& m){
+        // Every drop-th request is left unanswered: its call times out.
+        if(drop && ++requests % drop == 0) return;
+        (void)ch.reply(m.id, m.data, m.size);
+    });
+
+    std::vector<uint8_t> payload(static_cast<std::size_t>(size), 'x');
+    std::vector<uint64_t> lat;
+    lat.reserve(static_cast<std::size_t>(calls));
+    long issued = 0, completed = 0, timeouts = 0;
+    std::function<void()> issue = [&]{
+        auto t0 = now_ns();
+        ++issued;
+        (void)client.call(1, payload.data(), payload.size(), [&, t0](const rpc_channel::message& m){
+            if(m.status == rpc_channel::timeout) ++timeouts;
+            else if(m.status == rpc_channel::ok) lat.push_back(now_ns() - t0);
+            if(++completed == calls)
+            {
+                (void)l.shutdown();
+                return;
+            }
+            if(issued < calls) issue();
+        }, timeout_ms);
+    };
+
+    auto t0 = now_ns();
+    for(long x = 0; x < window && issued < calls; x++) issue();
+    (void)l.run();
+    auto ns = now_ns() - t0;
+
+    std::sort(lat.begin(), lat.end());
+    std::cout << "  window " << window << ": " << completed << " calls in " << ns / 1000000.0 << " ms, "
+              << static_cast<double>(completed) * 1e9 / static_cast<double>(ns) << " calls/s, "
+              << static_cast<double>(client.calls()) / static_cast<double>(client.writes() ? client.writes() : 1)
+              << " requests/send; latency p50 " << percentile(lat, 0.50) / 1000.0 << " usec, p99 "
+              << percentile(lat, 0.99) / 1000.0 << " usec";
+    if(drop) std::cout << "; " << timeouts << " timed out";
+    std::cout << "\n";
+}
+
+}
+
+
+/*!
+ * \brief rpc - pipelined calls over one loopback tcp connection, client and server channels on the same listener.
+ *
+ *     iolistener_bench rpc [calls=200000] [window=64] [size=64] [drop=0] [timeout_ms=20]
+ *
+ *     Runs with one outstanding call, then with \a window of them. The server leaves every drop-th request unanswered:
+ *     those calls complete with rpc_channel::timeout after timeout_ms.
+ */
+int rpc(int argc, char** argv)
+{
+    auto calls = arg(argc, argv, 1, 200000);
+    auto window = arg(argc, argv, 2, 64);
+    auto size = arg(argc, argv, 3, 64);
+    auto drop = arg(argc, argv, 4, 0);
+    auto timeout_ms = static_cast<uint32_t>(arg(argc, argv, 5, 20));
+    run(calls, 1, size, drop, timeout_ms);
+    run(calls, window, size, drop, timeout_ms);
+    return 0;
+}
+
+}
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/shm_channel.h"
+#include <sys/wait.h>
+#include <poll.h>
+#include <sched.h>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct consumer
+{
+    listener*    l = nullptr;
+    shm_channel* ch = nullptr;
+    int          sock = -1;
+    long         expected = 0;
+    long         count = 0;
+    uint64_t     bytes = 0;
+    char         buf[64 * 1024];
+
+    expect<> on_read(ifd&)
+    {
+        while(true)
+        {
+            ssize_t n;
+            if(ch)
+            {
+                auto R = ch->recv(buf, sizeof(buf));
+                n = R ? static_cast<ssize_t>(*R) : 0;
+            }
+            else
+                n = ::recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+            if(n <= 0) break;
+            bytes += n;
+            if(++count == expected) return l->shutdown();
+        }
+        return rem::ok;
+    }
+};
+
+
+void produce(bool shm, unix_socket& s, long messages, std::size_t size)
+{
+    std::vector<char> msg(size, 'm');
+    shm_channel ch;
+    if(shm)
+    {
+        pollfd p{s.fd(), POLLIN, 0};
+        ::poll(&p, 1, -1);
+        if(!ch.receive_from(s)) ::_exit(1);
+    }
+    for(long x = 0; x < messages; x++)
+    {
+        if(shm)
+        {
+            while(true)
+            {
+                auto R = ch.send(msg.data(), size);
+                if(!R) ::_exit(1);
+                if(*R != rem::overflow) break;
+                sched_yield();
+            }
+            continue;
+        }
+        while(::send(s.fd(), msg.data(), size, MSG_NOSIGNAL) < 0)
+        {
+            if(errno != EAGAIN) ::_exit(1);
+            pollfd p{s.fd(), POLLOUT, 0};
+            ::poll(&p, 1, -1);
+        }
+    }
+    ::_exit(0);
+}
+
+}
+
+
+/*!
+ * \brief shm - messages/s from a child process to the listener: shm_channel against an AF_UNIX seqpacket socket.
+ *
+ *     iolistener_bench shm [messages=2000000] [size=64] [unix=0]
+ *
+ *     The shm_channel descriptors are handed to the child over the AF_UNIX socket (SCM_RIGHTS). The producer yields when
+ *     the ring is full; the consumer reads in the read_signal of the doorbell until recv() returns 0.
+ */
+int shm(int argc, char** argv)
+{
+    auto messages = arg(argc, argv, 1, 2000000);
+    auto size     = static_cast<std::size_t>(arg(argc, argv, 2, 64));
+    bool use_shm  = arg(argc, argv, 3, 0) == 0;
+
+    unix_socket a, b;
+    if(!unix_socket::pair(a, b, unix_socket::type::seqpacket)) return 1;
+    listener l(nullptr, -1);
+    shm_channel ch;
+    consumer c;
+    c.l = &l;
+    c.expected = messages;
+    if(use_shm)
+    {
+        if(!ch.create(4 * 1024 * 1024) || !ch.attach(l)) return 1;
+        ch.i_fd()->read_signal().connect(&c, &consumer::on_read);
+        c.ch = &ch;
+    }
+    else
+    {
+        if(!a.attach(l)) return 1;
+        a.i_fd()->read_signal().connect(&c, &consumer::on_read);
+        c.sock = a.fd();
+    }
+
+    auto t0 = now_ns();
+    pid_t pid = ::fork();
+    if(pid < 0) return 1;
+    if(!pid) produce(use_shm, b, messages, size);
+    if(use_shm && !ch.send_to(a)) return 1;
+
+    (void)l.run();
+    auto elapsed = now_ns() - t0;
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+
+    std::cout << "  " << (use_shm ? "shm_channel" : "AF_UNIX seqpacket") << ": " << c.count << " messages of " << size
+              << " bytes in " << elapsed / 1000000.0 << " ms, " << c.count / (elapsed / 1e9) / 1e6 << " M messages/s, "
+              << c.bytes / (elapsed / 1e9) / (1024.0 * 1024.0) << " MiB/s\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/listener.h"
+#include "iolistener/sim_poller.h"
+#include <cstring>
+#include <iostream>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+/*!
+ * \brief framer - length-prefixed messages (4 bytes little-endian length, payload) reassembled across deliveries; each
+ * complete message is acknowledged with 4 bytes written back.
+ */
+struct framer : public object
+{
+    struct state
+    {
+        uint32_t need = 0;    ///< payload bytes left in the current message.
+        uint8_t  have = 0;    ///< header bytes received.
+        uint8_t  hdr[4]{};
+    };
+
+    sim_poller* sim = nullptr;
+    std::vector<state> conns;  ///< fd-indexed.
+    uint64_t messages = 0, closed = 0;
+
+    framer() : object(nullptr, "bench::framer") {}
+
+    rem::code on_read(ifd& f)
+    {
+        auto& s = conns[f.fd];
+        auto* p = f.internal_buffer;
+        auto n = f.pksize;
+        while(n)
+        {
+            if(s.have < 4)
+            {
+                auto take = std::min<std::size_t>(4 - s.have, n);
+                std::memcpy(s.hdr + s.have, p, take);
+                s.have += take;
+                p += take;
+                n -= take;
+                if(s.have < 4) break;
+                s.need = s.hdr[0] | s.hdr[1] << 8 | s.hdr[2] << 16 | static_cast<uint32_t>(s.hdr[3]) << 24;
+            }
+            auto take = std::min<std::size_t>(s.need, n);
+            p += take;
+            n -= take;
+            s.need -= take;
+            if(s.need) break;
+            s.have = 0;
+            ++messages;
+            (void)sim->write(f.fd, s.hdr, 4);
+        }
+        return rem::ok;
+    }
+    rem::code on_write(ifd&) { return rem::ok; }
+    void on_close(ifd&) { ++closed; }
+    expect<> on_signal(ifd& f) { return on_read(f); }
+};
+
+static_assert(handler<framer>);
+
+}
+
+
+/*!
+ * \brief sim - the listener over io::sim_poller: dispatch, framing and handler costs without the kernel.
+ *
+ *     iolistener_bench sim [connections=1000000] [rounds=10] [size=64] [delivery=4096] [signal=0]
+ *
+ *     Each round injects one framed message of \a size bytes on every virtual connection; the handler reassembles it
+ *     (deliveries of \a delivery bytes may split the frames) and writes an acknowledgment back. signal=1 dispatches
+ *     through read_signal instead of the io::handler form.
+ */
+int sim(int argc, char** argv)
+{
+    long conns = arg(argc, argv, 1, 1000000);
+    long rounds = arg(argc, argv, 2, 10);
+    long size = arg(argc, argv, 3, 64);
+    long delivery = arg(argc, argv, 4, 4096);
+    bool signal = arg(argc, argv, 5, 0) != 0;
+
+    auto owned = std::make_unique<sim_poller>();
+    auto* sim = owned.get();
+    sim->set_delivery_size(static_cast<std::size_t>(delivery));
+    listener l(nullptr, -1);
+    if(!l.set_poller(std::move(owned)) || !l.init()) return 1;
+
+    framer h;
+    h.sim = sim;
+    h.conns.resize(static_cast<std::size_t>(sim_poller::first_fd + conns));
+    std::vector<int> fds(static_cast<std::size_t>(conns));
+    auto t0 = now_ns();
+    for(auto& fd : fds)
+    {
+        fd = sim->open();
+        (void)l.add_ifd(fd, ifd::O_READ);
+        if(signal) l.query_fd(fd)->read_signal().connect(&h, &framer::on_signal);
+    }
+    auto setup = now_ns() - t0;
+
+    std::vector<uint8_t> frame(4 + static_cast<std::size_t>(size), 'x');
+    frame[0] = size & 0xff;
+    frame[1] = (size >> 8) & 0xff;
+    frame[2] = (size >> 16) & 0xff;
+    frame[3] = (size >> 24) & 0xff;
+
+    long round = 0;
+    // Called by the poller when nothing is ready: the previous round is fully dispatched.
+    sim->set_driver([&]{
+        for(auto fd : fds) sim->output(fd)->clear();
+        if(round++ == rounds)
+        {
+            (void)l.shutdown();
+            return;
+        }
+        for(auto fd : fds) (void)sim->inject(fd, frame.data(), frame.size());
+    });
+
+    t0 = now_ns();
+    if(signal) (void)l.run();
+    else (void)l.run(h);
+    auto ns = now_ns() - t0;
+
+    auto expected = static_cast<uint64_t>(conns) * rounds;
+    std::cout << "  " << conns << " virtual connections, " << (signal ? "read_signal" : "io::handler") << ", set up in "
+              << setup / 1000000.0 << " ms, table " << l.table().memory_usage() / (1024 * 1024) << " MiB\n";
+    std::cout << "  " << h.messages << " messages (" << (h.messages == expected ? "none" : "SOME") << " lost), "
+              << sim->delivered_events() << " events, " << sim->delivered_bytes() / (1024 * 1024) << " MiB in "
+              << ns / 1000000.0 << " ms\n";
+    std::cout << "  " << static_cast<double>(h.messages) * 1e3 / static_cast<double>(ns) << " M messages/s, "
+              << static_cast<double>(ns) / static_cast<double>(sim->delivered_events()) << " ns/event\n";
+    return h.messages == expected ? 0 : 1;
+}
+
+}
@@ -0,0 +1,164 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/file_tail.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct record
+{
+    uint64_t stamp;
+    uint64_t seq;
+};
+
+struct tail_reader
+{
+    listener* l = nullptr;
+    std::vector<uint64_t> latency;
+    std::atomic<long> received{0};
+    long rotations = 0;
+    char buf[64 * 1024];
+
+    expect<> on_read(ifd& f)
+    {
+        // Records are written whole: read a multiple of their size, the rest stays for the next call.
+        auto want = std::min(f.pksize, sizeof(buf)) / sizeof(record) * sizeof(record);
+        auto n = ::read(f.fd, buf, want);
+        if(n <= 0) return rem::ok;
+        auto now = now_ns();
+        for(std::size_t x = 0; x + sizeof(record) <= static_cast<std::size_t>(n); x += sizeof(record))
+        {
+            record r;
+            std::memcpy(&r, buf + x, sizeof(r));
+            latency.push_back(now - r.stamp);
+        }
+        received += n / sizeof(record);
+        return rem::ok;
+    }
+    expect<> on_rotated(ifd&) { ++rotations; return rem::ok; }
+    expect<> on_stop(ifd&) { return l->shutdown(); }
+};
+
+}
+
+
+/*!
+ * \brief tail - pickup latency of appended records through file_tail, with files rotated during the run.
+ *
+ *     iolistener_bench tail [files=1000] [writes=20000] [rotate_every=1000] [pace_usec=50]
+ *
+ *     A writer thread appends 16 bytes records (write time stamp) to the files in turn, one every pace_usec. Every
+ *     rotate_every writes, the current file is renamed, one more record goes to the renamed file, then a new file is
+ *     created - no record may be lost.
+ */
+int tail(int argc, char** argv)
+{
+    auto nfiles       = static_cast<int>(arg(argc, argv, 1, 1000));
+    auto writes       = arg(argc, argv, 2, 20000);
+    auto rotate_every = arg(argc, argv, 3, 1000);
+    auto pace         = arg(argc, argv, 4, 50);
+
+    char tmpl[] = "/tmp/iolistener-tail-XXXXXX";
+    if(!::mkdtemp(tmpl)) return 1;
+    std::string dir = tmpl;
+    auto name = [&](int x){ return dir + "/" + std::to_string(x) + ".log"; };
+
+    std::vector<int> out(nfiles);
+    for(int x = 0; x < nfiles; x++)
+        out[x] = ::open(name(x).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    listener l(nullptr, -1);
+    file_tail t(nullptr);
+    tail_reader r;
+    r.l = &l;
+    r.latency.reserve(writes + writes / (rotate_every ? rotate_every : writes) + 1);
+    if(!t.attach(l)) return 1;
+    ifd* first = nullptr;
+    for(int x = 0; x < nfiles; x++)
+    {
+        auto f = t.watch(name(x), true);
+        if(!f) return 1;
+        if(!first)
+        {
+            first = *f;
+            first->read_signal().connect(&r, &tail_reader::on_read);
+        }
+        else
+            (*f)->share_handlers(*first);
+    }
+    t.rotated_signal().connect(&r, &tail_reader::on_rotated);
+
+    int stop[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, stop) < 0) return 1;
+    (void)l.add_ifd(stop[0], ifd::O_READ);
+    l.query_fd(stop[0])->read_signal().connect(&r, &tail_reader::on_stop);
+    std::thread loop([&]{ (void)l.run(); });
+
+    long written = 0;
+    uint64_t seq = 0;
+    auto t0 = now_ns();
+    for(long x = 0; x < writes; x++)
+    {
+        int k = static_cast<int>(x % nfiles);
+        record rec{now_ns(), seq++};
+        if(::write(out[k], &rec, sizeof(rec)) == sizeof(rec)) ++written;
+        if(rotate_every && x && !(x % rotate_every))
+        {
+            auto p = name(k);
+            (void)::rename(p.c_str(), (p + ".1").c_str());
+            rec = {now_ns(), seq++};
+            if(::write(out[k], &rec, sizeof(rec)) == sizeof(rec)) ++written; // late write into the rotated file.
+            ::close(out[k]);
+            out[k] = ::open(p.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        if(pace) std::this_thread::sleep_for(std::chrono::microseconds(pace));
+    }
+    auto deadline = now_ns() + 5000000000ull;
+    while(r.received < written && now_ns() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto elapsed = now_ns() - t0;
+    (void)::write(stop[1], "x", 1);
+    loop.join();
+
+    for(int x = 0; x < nfiles; x++)
+    {
+        ::close(out[x]);
+        ::unlink(name(x).c_str());
+        ::unlink((name(x) + ".1").c_str());
+    }
+    ::rmdir(dir.c_str());
+    ::close(stop[0]);
+    ::close(stop[1]);
+
+    std::sort(r.latency.begin(), r.latency.end());
+    std::cout << "  " << nfiles << " files: " << r.received << " of " << written << " records in " << elapsed / 1000000.0
+              << " ms, " << r.rotations << " rotations; pickup p50 " << percentile(r.latency, 0.50) / 1000.0 << " usec, p99 "
+              << percentile(r.latency, 0.99) / 1000.0 << " usec, p99.9 " << percentile(r.latency, 0.999) / 1000.0 << " usec\n";
+    return 0;
+}
+
+}
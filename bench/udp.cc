@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "bench.h"
+#include "iolistener/udp_socket.h"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+
+using namespace book;
+
+namespace io::bench
+{
+
+namespace
+{
+
+struct udp_sink : public object
+{
+    listener* l = nullptr;
+    uint64_t datagrams = 0, bytes = 0, deadline = 0;
+
+    udp_sink() : object(nullptr, "bench::udp_sink") {}
+    expect<> on_batch(udp_socket::batch& b)
+    {
+        datagrams += b.size();
+        for(auto const& d : b) bytes += d.size;
+        if(now_ns() >= deadline) l->shutdown();
+        return rem::ok;
+    }
+    expect<> on_idle()
+    {
+        if(now_ns() >= deadline) l->shutdown();
+        return rem::ok;
+    }
+};
+
+}
+
+
+/*!
+ * \brief udp - loopback datagrams per second through a udp_socket attached to a listener.
+ *
+ *     iolistener_bench udp [seconds=2] [size=64] [batch=64] [gro=0]
+ *
+ *     The sender thread pushes sendmmsg() batches of \a batch datagrams; the receiver takes up to \a batch per recvmmsg().
+ *     Run with batch=1 for the one-syscall-per-datagram reference.
+ */
+int udp(int argc, char** argv)
+{
+    auto seconds = arg(argc, argv, 1, 2);
+    auto size    = static_cast<std::size_t>(arg(argc, argv, 2, 64));
+    auto count   = static_cast<std::size_t>(arg(argc, argv, 3, 64));
+    bool gro     = arg(argc, argv, 4, 0) != 0;
+
+    listener l(nullptr, 100);
+    udp_socket rx(nullptr, "bench::rx");
+    if(rx.create() < 0 || !rx.bind("127.0.0.1:0")) return 1;
+    (void)rx.set_batch(count, udp_socket::default_slot);
+    if(gro && !rx.enable_gro()) std::cout << "  (no GRO on this kernel)\n";
+    (void)rx.attach(l);
+
+    udp_sink sink;
+    sink.l = &l;
+    sink.deadline = now_ns() + seconds * 1000000000ull;
+    rx.batch_signal().connect(&sink, &udp_sink::on_batch);
+    l.idle_signal().connect(&sink, &udp_sink::on_idle);
+
+    std::atomic<bool> stop{false};
+    uint64_t sent = 0;
+    std::string dest = "127.0.0.1:" + std::to_string(rx.port());
+    std::thread tx_thread([&]{
+        udp_socket tx(nullptr, "bench::tx");
+        if(tx.create() < 0 || !tx.connect(dest)) return;
+        (void)tx.set_batch(count, udp_socket::default_slot);
+        std::vector<uint8_t> payload(size, 'u');
+        udp_socket::batch b(count, udp_socket::datagram{payload.data(), size, nullptr, 0});
+        while(!stop)
+        {
+            auto S = tx.send(b.data(), b.size());
+            if(S) sent += *S;
+            if(S && !*S) std::this_thread::yield();
+        }
+    });
+
+    auto t0 = now_ns();
+    (void)l.run();
+    auto ns = now_ns() - t0;
+    stop = true;
+    tx_thread.join();
+
+    std::cout << "  batch " << count << ", " << size << " bytes: sent " << sent << ", received " << sink.datagrams
+              << " datagrams in " << rx.calls() << " recvmmsg calls; "
+              << static_cast<uint64_t>(sink.datagrams * 1e9 / ns) << " datagrams/s\n";
+    return 0;
+}
+
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include "iolistener/shared_buffer.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+
+#include <deque>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The broadcaster class - fan-out of the same messages to many descriptors of a listener.
+ *
+ * publish() queues one shared_buffer on the output queue of every subscriber: a reference, not a copy - the
+ * application builds the message once whatever the number of subscribers. The queues are written at the end of the loop
+ * iteration (listener::flush()), with one sendmsg() gathering the queued messages of each subscriber; EPOLLOUT is armed
+ * for the subscribers whose socket is full only. A buffer is freed once the last subscriber has sent it (and the
+ * publisher released its handle).
+ *
+ * A subscriber whose queue goes over the limits is slow; limits::slow tells what is done:
+ *   - disconnect : it is unsubscribed, then dropped_signal() - the application closes it;
+ *   - drop_oldest: its oldest queued messages not yet started are dropped to make room;
+ *   - conflate   : a queued message not yet started with the same (non-zero) key is replaced by the new one - a
+ *                  newer value of the same instrument; without such message, as drop_oldest.
+ * A partly sent message is never dropped - the stream would be cut in the middle of it: when it is all that is left, the
+ * queue goes over its limits by the new message (stats::overrun).
+ *
+ * Listener thread only.
+ */
+class broadcaster : public book::object
+{
+public:
+    enum class policy : uint8_t { disconnect, drop_oldest, conflate };
+
+    struct limits
+    {
+        std::size_t max_messages = 1024;       ///< queued per subscriber.
+        std::size_t max_bytes = 4 * 1024 * 1024;
+        policy      slow = policy::disconnect;
+    };
+
+    struct stats
+    {
+        uint64_t published = 0;     ///< publish() calls.
+        uint64_t queued = 0;        ///< messages queued, all subscribers.
+        uint64_t sent_bytes = 0;
+        uint64_t syscalls = 0;
+        uint64_t dropped = 0;       ///< messages dropped by drop_oldest / conflate.
+        uint64_t conflated = 0;     ///< messages replaced by a newer one of the same key.
+        uint64_t disconnected = 0;  ///< slow or failed subscribers dropped.
+        uint64_t overrun = 0;       ///< messages queued over the limits: only a partly sent one was left to drop.
+    };
+
+private:
+    struct item
+    {
+        shared_buffer buffer;
+        uint32_t key = 0;
+    };
+    struct subscriber
+    {
+        int fd = -1;
+        int wfd = -1;               ///< in the listener with the broadcaster's slots: fd, or a dup of it (not added).
+        bool added = false;         ///< fd added to the listener by subscribe(): removed by unsubscribe().
+        bool socket = true;         ///< sendmsg(); writev() otherwise (pipe).
+        std::size_t offset = 0;     ///< bytes of the front item already sent.
+        std::size_t bytes = 0;      ///< queued bytes.
+        std::deque<item> queue;
+    };
+
+    listener*   _listener = nullptr;
+    limits      _limits;
+    stats       _stats;
+    std::vector<subscriber> _subs;
+    std::vector<int> _index;        ///< fd and wfd -> _subs index + 1; 0: not a subscriber.
+    std::vector<int> _slow;         ///< subscribers to disconnect after the publish() loop.
+    book::notify<int> _dropped_signal{"broadcast dropped"};
+
+    subscriber* query(int fd);
+    void index(int fd, int x);
+    bool make_room(subscriber& s, const shared_buffer& b, uint32_t key);
+    void drop(int fd);
+    book::expect<> writable(ifd& f);
+    book::expect<> hangup(ifd& f);
+
+public:
+    broadcaster(book::object* parent, const std::string& ii, listener& l);
+    broadcaster(book::object* parent, const std::string& ii, listener& l, limits lim);
+    ~broadcaster() override;
+
+    book::expect<> subscribe(int fd);
+    book::expect<> unsubscribe(int fd);
+    book::expect<std::size_t> publish(const shared_buffer& b, uint32_t key = 0);
+
+    std::size_t subscribers() const { return _subs.size(); }
+    bool subscribed(int fd) { auto* s = query(fd); return s && s->fd == fd; }
+    std::size_t queued(int fd);
+    const stats& statistics() const { return _stats; }
+    book::notify<int>& dropped_signal() { return _dropped_signal; }
+};
+
+}
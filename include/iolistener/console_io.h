@@ -85,7 +85,7 @@ public:
     console_io(object* parent_obj);
     ~console_io();
     std::thread& thread_id() { return io_thread;}
-    rem::code start();
+    rem::code start(int cpu = -1);
     rem::code fin();
     void operator()(); ///< Callable object as Set as the (std::)thread starter;
     notify<>& idle_notifier() { return _idle_signal; }
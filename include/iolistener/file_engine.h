@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The file_engine class - asynchronous regular-file i/o for the listener thread.
+ *
+ * epoll does not take regular files (listener::add_ifd() fails with EPERM), and a read on them blocks the loop.
+ * The engine runs the positioned reads/writes (pread/pwrite, in chunks of up to chunk_size bytes) on a small pool of
+ * threads. Completed requests are queued back and an eventfd registered in the listener - attach() - rings the loop:
+ * the completions are then delivered on the listener thread, to the request's callback and to completion_signal().
+ *
+ * With files opened O_DIRECT (open(path, flags, true)), offsets, sizes and buffers must be multiples of
+ * file_engine::alignment: use file_engine::alloc() for the buffers.
+ */
+class file_engine : public book::object
+{
+public:
+    static constexpr std::size_t alignment = 4096;
+
+    enum class op : uint8_t { read, write, fsync };
+
+    struct request
+    {
+        using done_fn = std::function<void(request&)>;
+        op          what = op::read;
+        int         fd = -1;
+        uint64_t    offset = 0;
+        uint8_t*    data = nullptr;
+        std::size_t size = 0;
+        uint64_t    user = 0;          ///< caller's tag.
+        done_fn     done;
+        // Result, set by the engine:
+        std::size_t bytes = 0;         ///< bytes transferred; a read shorter than size reached the end of file.
+        int         error = 0;         ///< errno of the failed call, 0 if none.
+    };
+
+private:
+    using request_ptr = std::unique_ptr<request>;
+
+    std::size_t                 _chunk;
+    std::size_t                 _nthreads;
+    std::vector<std::thread>    _threads;
+    std::mutex                  _qmtx;
+    std::condition_variable     _qcv;
+    std::deque<request_ptr>     _queue;
+    std::mutex                  _dmtx;
+    std::vector<request_ptr>    _done;
+    std::vector<request_ptr>    _ready;  ///< listener thread side of _done.
+    int                         _efd = -1;
+    listener*                   _listener = nullptr;
+    bool                        _stop = false;
+    std::size_t                 _pending = 0; ///< submitted, not delivered - listener thread only.
+    book::notify<request&>      _completion_signal{"file completion"};
+
+    void worker();
+    void execute(request& r);
+    book::expect<> doorbell(ifd& f);
+    book::expect<> submit(request_ptr r);
+
+public:
+    explicit file_engine(book::object* parent, std::size_t threads = 2, std::size_t chunk_size = 1024 * 1024);
+    ~file_engine() override;
+
+    book::expect<> attach(listener& l);
+    book::expect<> stop();
+
+    static book::expect<int> open(const std::string& path, int flags, bool direct = false, mode_t mode = 0644);
+    static uint8_t* alloc(std::size_t size);
+    static void release(uint8_t* buffer);
+
+    book::expect<> read(int fd, uint64_t offset, uint8_t* data, std::size_t size, request::done_fn done = nullptr, uint64_t user = 0);
+    book::expect<> write(int fd, uint64_t offset, const uint8_t* data, std::size_t size, request::done_fn done = nullptr, uint64_t user = 0);
+    book::expect<> fsync(int fd, request::done_fn done = nullptr, uint64_t user = 0);
+
+    std::size_t pending() const { return _pending; }
+    book::notify<request&>& completion_signal() { return _completion_signal; }
+};
+
+}
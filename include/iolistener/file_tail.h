@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The file_tail class - follows appended data of files (logs) through one inotify descriptor in the listener.
+ *
+ * Each watched file has its own ifd, not in the epoll set (epoll does not take regular files): on IN_MODIFY its
+ * read_signal is emitted with pksize = the appended bytes (up to chunk_size per call), and the handler read()s them
+ * from ifd::fd - the same handler as for a socket. The file offset is where the handler left the fd.
+ *
+ * Rotation: the directory is watched too. When a file of the same name appears (IN_CREATE, IN_MOVED_TO), what is left in
+ * the old file is read out, then the new one is followed from its start; rotated_signal() is emitted with the ifd.
+ * A truncated file (copy-truncate rotation) is read again from its start. A watched file that does not exist yet is
+ * picked up when it is created.
+ * \note A file rotated again before the event of its creation is handled - faster than the listener keeps up - is
+ * never opened: its content is missed, as with any name-based tail.
+ *
+ * Idle files cost nothing: no polling, only the inotify descriptor in the listener.
+ */
+class file_tail : public book::object
+{
+public:
+    static constexpr std::size_t chunk_size = 1024 * 1024;
+
+private:
+    struct file
+    {
+        std::string path;
+        std::string name;        ///< in its directory.
+        int         wd = -1;     ///< watch of the file itself.
+        int         dir_wd = -1;
+        off_t       offset = 0;
+        ifd         f;           ///< f.fd = -1 while the file does not exist.
+    };
+
+    int         _fd = -1;        ///< inotify.
+    listener*   _listener = nullptr;
+    std::vector<std::unique_ptr<file>>           _files;
+    std::unordered_map<int, file*>               _by_wd;
+    std::unordered_multimap<int, file*>          _by_dir;
+    book::notify<ifd&>                           _rotated_signal{"rotated"};
+
+    book::expect<> events(ifd& f);
+    book::expect<> open_file(file& t, bool from_start);
+    void close_file(file& t);
+    void pump(file& t);
+
+public:
+    explicit file_tail(book::object* parent);
+    ~file_tail() override;
+
+    book::expect<> attach(listener& l);
+    book::expect<ifd*> watch(const std::string& path, bool from_start = false);
+    book::expect<> unwatch(const std::string& path);
+    std::size_t count() const { return _files.size(); }
+    book::notify<ifd&>& rotated_signal() { return _rotated_signal; }
+};
+
+}
@@ -0,0 +1,52 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/ifd.h"
+#include <logbook/expect.h>
+#include <concepts>
+
+
+namespace io
+{
+
+/*!
+ * \brief handler - the statically dispatched alternative to the ifd notify signals.
+ *
+ * A handler is any type with:
+ *   - book::rem::code on_read(ifd&)  : data is ready on the descriptor (ifd::pksize bytes, or in ifd::internal_buffer with I_AUTOFILL);
+ *   - book::rem::code on_write(ifd&) : the descriptor is ready for write, or was queued by listener::flush();
+ *   - void on_close(ifd&)             : hangup, error or zero-length read - the descriptor is removed from the listener after this call.
+ * Optional:
+ *   - void on_idle()                  : the listener wait timed-out.
+ *   - book::rem::code on_urgent(ifd&) : EPOLLPRI - out-of-band/priority data; without it, EPOLLPRI goes to on_read.
+ *   - book::rem::code on_window(ifd&) : O_WINDOWED - the window is complete in ifd::internal_buffer; without it, on_read.
+ *
+ * on_read is also called with ifd::pksize == 0 for a continuation dispatch - the descriptor was carried over from the
+ * previous iteration (see listener::carry()) - and on a listening socket with a connection ready to accept(): it reads
+ * zero bytes (FIONREAD) without being at its end, so it does not go to on_close.
+ *
+ * Returning book::rem::end from on_read or on_write terminates the loop, the same way a rem::end from a read_signal slot does.
+ * Handed to listener::run(H&), the calls are resolved at compile time and can be inlined in the loop - no slot list,
+ * no expect<> round-trips. Use the signals when several subscribers are needed on the same descriptor.
+ */
+template<typename H>
+concept handler = requires(H& h, ifd& f)
+{
+    { h.on_read(f) } -> std::convertible_to<book::rem::code>;
+    { h.on_write(f) } -> std::convertible_to<book::rem::code>;
+    h.on_close(f);
+};
+
+}
@@ -14,6 +14,7 @@
 #include "iolistener/public.h"
 #include <logbook/notify.h>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <unistd.h>
@@ -23,20 +24,47 @@ namespace io
 {
 
 
-
-struct ifd final
+/*!
+ * \brief The ifd struct - io file descriptor record.
+ *
+ * The record is laid out hot-first: what the listener loop touches on every event (fd, options, state, packet size and buffer
+ * cursor) sits in the first half of one cache line. The notify handlers are kept out of the record in a separate
+ * ifd::handlers block that is allocated on first use and can be shared between descriptors serving the same protocol.
+ *
+ * \note Records are owned by the io::ifd_table of the listener and never move once added - so a ifd& held by a handler stays
+ * valid until the descriptor is removed.
+ */
+struct alignas(64) ifd final
 {
 
 public:
-    using list = std::vector<ifd>;
-    using iterator = ifd::list::iterator;
 
-    book::notify<ifd&>
-        read_signal,
-        write_signal,
-        idle_signal,
-        zero_signal,
-        window_complete_signal;
+    /*!
+     * \brief Cold part of the ifd: the notify handlers.
+     */
+    struct handlers
+    {
+        using shared = std::shared_ptr<handlers>;
+        book::notify<ifd&>
+            read_signal,
+            write_signal,
+            idle_signal,
+            zero_signal,
+            window_complete_signal,
+            urgent_signal;      ///< EPOLLPRI: out-of-band / priority data pending.
+    };
+
+    /*!
+     * \brief Dispatch class of the descriptor. Within one listener iteration, the ready descriptors are dispatched
+     * class by class: all control ones first, then normal, then bulk.
+     */
+    enum class priority : uint8_t
+    {
+        control = 0,    ///< signalling, timers, doorbells - latency sensitive, small.
+        normal,
+        bulk            ///< large transfers: dispatched last.
+    };
+    static constexpr std::size_t priority_classes = 3;
 
     // Option flags - yes static constexpr:
     static constexpr uint32_t O_READ  = 0x01; ///< readeable
@@ -48,38 +76,77 @@ public:
     static constexpr uint32_t O_IMM   = 0x20; ///< Notify to delegates immediately when a read is made.
     static constexpr uint32_t O_WINDOWED = 0x40; ///< Wait/Window size to be received/sent/written (from internal automatic buffer/ or external temp file) enabled. ifd::signal_t emitted only when window filled/flushed @note anything past m_wsize is discarded/ignored
     static constexpr uint32_t I_AUTOFILL = 0x80; ///< Auto-fill internal/or external buffer before sending read or write signal. So the triggered read and write are done after the data bloc is read or written.
+    static constexpr uint32_t O_MSG   = 0x100; ///< Message descriptor (datagram or listening socket, eventfd, ...): no FIONREAD, a zero-length read is not an end of stream - read_signal pulls the data.
+    static constexpr uint32_t O_MEM   = 0x200; ///< Memory descriptor (io::sim_poller): the poller hands the bytes in internal_buffer/pksize - nothing is read from fd.
+
+    static constexpr std::size_t autofill_size = 4 * 1024; ///< Size of the internal buffer allocated for I_AUTOFILL.
+
+    // ------------- hot: touched by the listener loop on each event ----------------------
     int fd = -1;
-    std::size_t max_pksize = 1024 * 1024; ///< 1 megabytes by default. You have to set this value to your own limits for what you think is secure.
-    // For example, keyboard input would never-ever send more than 8 bytes into the input stream at once.
-    // So if you get more than 7 bytes it means something wrong is happening from the tty/pty/stdin stream.
-    uint32_t options;   ///< see option flags
-    std::size_t pksize;    ///< current packet size toread.
-    std::size_t wsize;     ///< Wait/Windodw size
-    std::size_t wpos;      ///< Wait/Window index where wpos >= 0 < wsize. | wpos == wsize-1 => Wait/Window:
-                           ///  receive/send/write complete.
-    u_int8_t* internal_buffer;
+    uint32_t options = 0;   ///< see option flags
     struct state_flags
     {
         uint8_t active  :1;    ///< This descriptor is active or not
         uint8_t destroy :1;    ///< this descriptor is marked to be deleted
         uint8_t writeable:1;   ///< this descriptor's fd is ready for write ( socketfd write ready event from epoll_wait )
         uint8_t readable:1;    ///< this descriptor's fd is ready for read ( socketfd read ready event from epoll_wait )
-    }state = {0,0,0,0};
+        uint8_t closing :1;    ///< the listener closes the fd when the record is released ( listener::close_ifd )
+        uint8_t more    :1;    ///< toread() clamped pksize to the budget: bytes are left in the fd.
+        uint8_t carry   :1;    ///< queued by the listener for a continuation dispatch on the next iteration ( listener::carry )
+        uint8_t queued  :1;    ///< in the ready list of the current iteration.
+    }state = {0,0,0,0,0,0,0,0};
+    priority prio = priority::normal;
+    struct flow_flags
+    {
+        uint8_t paused    :1;  ///< listener::pause_ifd(): EPOLLIN disarmed until resume_ifd().
+        uint8_t throttled :1;  ///< buffered bytes over the high watermark: EPOLLIN disarmed until drained to the low one.
+        uint8_t watch     :1;  ///< watermarks set ( listener::set_watermarks )
+        uint8_t want_out  :1;  ///< listener::want_write(): EPOLLOUT wanted.
+        uint8_t armed_in  :1;  ///< EPOLLIN in the epoll mask of the fd, as of now.
+        uint8_t armed_out :1;  ///< EPOLLOUT in the epoll mask of the fd, as of now.
+        uint8_t flush     :1;  ///< listener::flush(): write_signal / on_write at the end of the iteration.
+    }flow = {0,0,0,0,0,0,0};
+    uint32_t max_pksize = 1024 * 1024; ///< 1 megabytes by default. You have to set this value to your own limits for what you think is secure.
+    // For example, keyboard input would never-ever send more than 8 bytes into the input stream at once.
+    // So if you get more than 7 bytes it means something wrong is happening from the tty/pty/stdin stream.
+    std::size_t pksize = 0;    ///< current packet size toread.
+    u_int8_t* internal_buffer = nullptr;
+    uint32_t budget = 0;    ///< Bytes read per listener iteration; 0 = unlimited. See toread().
 
+    // ------------- cold ------------------------------------------------------------------
+    uint32_t wsize = 0;     ///< Wait/Windodw size
+    uint32_t wpos  = 0;     ///< Wait/Window index where wpos >= 0 < wsize. | wpos == wsize-1 => Wait/Window:
+                            ///  receive/send/write complete.
+private:
+    handlers::shared _handlers;
+
+public:
     ifd();
     ifd(int fd_, uint32_t options_);
     ifd(ifd&&) noexcept;
-    ifd(const ifd&) = default;
+    ifd(const ifd&) = delete;
     ifd& operator=(ifd&&) noexcept;
-    ifd& operator=(const ifd&) = default;
+    ifd& operator=(const ifd&) = delete;
 
     book::expect<std::size_t> set_window_size(uint32_t sz);
     book::expect<> data_in();
     uint32_t set_options(u_int32_t opt);
     std::size_t toread();
+    std::size_t fill();
+    bool window_in();
     book::expect<> clear();
     book::expect<std::size_t> out(uint8_t* datablock, std::size_t sz, bool wait_completed=true) const;
 
+    handlers& signals();
+    void share_handlers(const ifd& other);
+    bool has_handlers() const { return static_cast<bool>(_handlers); }
+    book::notify<ifd&>& read_signal() { return signals().read_signal; }
+    book::notify<ifd&>& write_signal() { return signals().write_signal; }
+    book::notify<ifd&>& idle_signal() { return signals().idle_signal; }
+    book::notify<ifd&>& zero_signal() { return signals().zero_signal; }
+    book::notify<ifd&>& window_complete_signal() { return signals().window_complete_signal; }
+    book::notify<ifd&>& urgent_signal() { return signals().urgent_signal; }
+
     ~ifd();
 
 };
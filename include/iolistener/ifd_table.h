@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+#pragma once
+
+#include "iolistener/ifd.h"
+#include <memory>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The ifd_table class - owns the ifd records of a listener.
+ *
+ * Records are allocated in fixed blocks of block_size contiguous ifd's (one cache line each) and are never moved:
+ * growing the table adds a block, it does not reallocate the existing ones. Released records go to a free list and are
+ * reused by the next add(). Lookup by file descriptor number is O(1) through a fd-indexed vector of pointers.
+ * The blocks are whole pages: set_node() places them on a NUMA node.
+ */
+class ifd_table
+{
+public:
+    static constexpr std::size_t block_size = 256;
+
+    ifd_table() = default;
+    ifd_table(const ifd_table&) = delete;
+    ifd_table& operator=(const ifd_table&) = delete;
+    ~ifd_table();
+
+    ifd* add(int fd_, uint32_t opt_);
+    ifd* query(int fd_) const;
+    void detach(ifd* f);
+    void release(ifd* f);
+    void clear();
+
+    std::size_t size() const { return _count; }
+    std::size_t capacity() const { return _blocks.size() * block_size; }
+    std::size_t memory_usage() const;
+    void set_node(int node);
+    int node() const { return _node; }
+
+    /*!
+     * \brief for_each calls fn(ifd&) for each record in use, in block order.
+     */
+    template<typename F> void for_each(F&& fn)
+    {
+        for(auto& b : _blocks)
+            for(std::size_t x = 0; x < block_size; x++)
+                if(b->r[x].fd >= 0) fn(b->r[x]);
+    }
+
+private:
+    struct alignas(4096) block
+    {
+        ifd r[block_size];
+    };
+    static_assert(sizeof(block) % 4096 == 0, "ifd_table::block is not a whole number of pages");
+
+    std::vector<std::unique_ptr<block>> _blocks;
+    std::vector<ifd*> _free;
+    std::vector<ifd*> _index; ///< fd -> record.
+    std::size_t _count = 0;
+    int _node = -1;                ///< NUMA node of the blocks; -1: default policy.
+};
+
+}
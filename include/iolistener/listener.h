@@ -12,7 +12,11 @@
 
 #pragma once
 
-#include "iolistener/ifd.h"
+#include "iolistener/ifd_table.h"
+#include "iolistener/handler.h"
+#include "iolistener/trace.h"
+#include "iolistener/poller.h"
+#include "iolistener/topology.h"
 #include <logbook/expect.h>
 #include <logbook/object.h>
 #include <logbook/notify.h>
@@ -25,14 +29,18 @@
 #include <sys/types.h>
 
 #include <sys/epoll.h>
+#include <sys/socket.h>
 
 #include <fcntl.h>
 #include <thread>
 #include <mutex>
+#include <array>
+#include <memory>
 
 
 using book::notify;
 using book::expect;
+using book::rem;
 
 namespace io
 {
@@ -40,17 +48,89 @@ namespace io
 
 class  listener :public book::object
 {
+public:
+    /*!
+     * \brief Hybrid busy-poll settings - see listener::set_busy_poll().
+     */
+    struct busy_poll
+    {
+        uint32_t spin_usec = 0;        ///< spin with a non-blocking epoll_wait for that long before blocking; 0 = never spin.
+        int      so_busy_poll = 0;     ///< SO_BUSY_POLL (usec) set on the registered sockets; 0 = leave the socket default.
+        bool     prefer_busy_poll = false; ///< SO_PREFER_BUSY_POLL (linux 5.11+) on the registered sockets.
+        int      cpu = -1;             ///< pin the thread running the loop to this cpu; -1 = no pinning.
+    };
+
+    /*!
+     * \brief Where the loop thread spends its wait time.
+     */
+    struct poll_stats
+    {
+        uint64_t spin_ns = 0;          ///< time spent spinning.
+        uint64_t sleep_ns = 0;         ///< time spent blocked in epoll_wait.
+        uint64_t spin_wakeups = 0;     ///< batches found while spinning.
+        uint64_t sleep_wakeups = 0;    ///< batches found after blocking.
+        uint64_t idle = 0;             ///< waits that timed-out with nothing.
+        uint64_t node_local = 0;       ///< memory reads of the loop thread served by its own NUMA node ( placement::counters ).
+        uint64_t node_remote = 0;      ///< memory reads of the loop thread served by another node - the remote-memory stalls.
+    };
 
-    ifd::list   _ifds;
+    /*!
+     * \brief Placement of the loop thread and of its memory - see listener::set_placement().
+     */
+    struct placement
+    {
+        int  cpu = -1;                 ///< pin the thread running the loop to this cpu; -1: busy_poll::cpu, if any.
+        int  node = -1;                ///< NUMA node of the loop's memory; -1: the node of cpu, if any.
+        bool counters = false;         ///< count the node-local/remote memory reads of the loop thread into stats() (perf events).
+    };
+
+private:
+
+    ifd_table   _ifds;
     int         _maxifd = 3;
+    int         _maxevents = 256; ///< size of the epoll_wait events batch.
     epoll_event _epoll_event;
-    int         _epollfd = -1;
+    std::unique_ptr<poller> _poller = std::make_unique<epoll_poller>(); ///< the readiness backend; epoll_poller unless set_poller().
     int         _epollnumfd = -1;
     bool        _terminate = false;
+    bool        _dispatching = false; ///< inside an events batch: removed records are kept until reap().
+    std::vector<ifd*> _zombies;       ///< records removed during the current batch.
+
+    /*!
+     * \brief ready entry of the current iteration; events == 0: continuation of a carried descriptor.
+     */
+    struct ready
+    {
+        ifd*     f;
+        uint32_t events;
+    };
+    std::array<std::vector<ready>, ifd::priority_classes> _ready; ///< the batch sorted by ifd::priority.
+    std::vector<ifd*> _carry;         ///< descriptors carried over to the next iteration.
+    std::vector<ifd*> _flush, _flushing; ///< descriptors to flush at the end of the iteration - see flush().
+    uint32_t    _budget = 0;          ///< ifd::budget of the descriptors added from now on.
+
+    /*!
+     * \brief Read flow control of a descriptor - see set_watermarks().
+     */
+    struct watermark
+    {
+        std::size_t high = 0;
+        std::size_t low = 0;
+        std::size_t buffered = 0;
+    };
+    std::vector<watermark> _marks;    ///< fd-indexed.
     notify<> _idle_signal{"idle"};
     notify<ifd&> _hup_signal{"hup"}, _error_signal{"error"}, _zero_signal{"zero"};
 
 
+    busy_poll   _busy;
+    poll_stats  _stats;
+    placement   _place;
+    int         _node = -1;           ///< resolved placement::node.
+    int         _perf[2] = {-1, -1};  ///< node access, node miss (remote) read counters of the loop thread.
+    uint64_t    _perf_base[2] = {0, 0};
+    trace_writer* _trace = nullptr;
+
     int msec = -1; ///< default to infinite.
 public:
     listener()  = default;
@@ -58,24 +138,261 @@ public:
     ~listener() override;
 
     expect<> run();
+    template<handler H> expect<> run(H& h);
     expect<> add_ifd(int fd_, uint32_t opt_);
     expect<> remove_ifd(int fd_);
+    expect<> close_ifd(int fd_);
     expect<> pause_ifd(int fd_);
+    expect<> resume_ifd(int fd_);
+    expect<> want_write(int fd_, bool on = true);
+    expect<> set_watermarks(int fd_, std::size_t high, std::size_t low);
+    expect<std::size_t> buffered(int fd_, std::ptrdiff_t delta);
     expect<> init();
     expect<> shutdown();
     notify<>& idle_signal() { return _idle_signal; }
-    notify<>& hup_signal() { return _idle_signal; }
-    notify<>& error_signal() { return _idle_signal; }
-    notify<>& zero_signal() { return _idle_signal; }
-    ifd::iterator query_fd(int fd_);
+    notify<ifd&>& hup_signal() { return _hup_signal; }
+    notify<ifd&>& error_signal() { return _error_signal; }
+    notify<ifd&>& zero_signal() { return _zero_signal; }
+    ifd* query_fd(int fd_);
+    std::size_t count() const { return _ifds.size(); }
+    const ifd_table& table() const { return _ifds; }
     expect<> start();
+    expect<> set_busy_poll(const busy_poll& cfg);
+    const busy_poll& busy_poll_config() const { return _busy; }
+    const poll_stats& stats() const { return _stats; }
+    void reset_stats();
+    expect<> set_placement(const placement& p);
+    const placement& placement_config() const { return _place; }
+    void sample_counters();
+    void set_trace(trace_writer* t) { _trace = t; }
+    void set_budget(uint32_t bytes) { _budget = bytes; }
+    expect<> set_poller(std::unique_ptr<poller> p);
+    poller* backend() { return _poller.get(); }
+    void carry(ifd& f);
+    void flush(ifd& f);
     void err_hup(ifd& f);
     expect<> epoll_data_in(ifd& i);
     expect<> epoll_data_out(ifd& i);
 
 
 private:
+    template<handler H> struct handler_dispatch;
+    template<typename D> expect<> loop(D& d);
+    template<typename D> void dispatch(ifd& i, uint32_t ev, D& d);
+    void discard(ifd* i);
+    void reap();
+    void collect(const epoll_event* events, int n);
+    void rearm(ifd& i);
+    int  wait(epoll_event* events);
+    void set_busy_poll_sockopt(int fd);
+    void pin_thread();
+    void end_run();
+};
+
+
+/*!
+ * \brief listener::run(H&) the loop with statically dispatched handler - see io::handler.
+ *
+ * Same descriptors, same epoll set and same dispatch rules as run() - both are loop() - but the ifd signals are not
+ * invoked. The handlers may remove_ifd()/close_ifd()/pause_ifd() any descriptor during the batch.
+ */
+template<handler H> expect<> listener::run(H& h)
+{
+    handler_dispatch<H> d{*this, h};
+    return loop(d);
+}
+
+
+/*!
+ * \brief listener::loop the event loop of run() and run(H&): wait, dispatch the batch class by class, flush, reap.
+ *
+ * \a d delivers the events to the application - the ifd signals or the io::handler calls:
+ *   - rem::code read(ifd&), write(ifd&), window(ifd&) : data ready (or continuation), fd writable (or flushed), O_WINDOWED window complete;
+ *   - bool urgent(ifd&, rem::code&) : EPOLLPRI, false when not handled - it is then read as EPOLLIN;
+ *   - void close(ifd&) : error or hangup, the descriptor is to be removed;
+ *   - void zero(ifd&)  : zero-length read on a stream descriptor;
+ *   - void idle()      : the wait timed-out.
+ */
+template<typename D> expect<> listener::loop(D& d)
+{
+    if(!_epoll_event.events)
+        return rem::push_info(HERE) << "events poll empty - dismissing this listener";
+
+    pin_thread();
+    std::vector<epoll_event> events(_maxevents);
+    do{
+        int ev_count = wait(events.data());
+        if(ev_count <= 0 && _carry.empty() && _flush.empty())
+        {
+            if(!ev_count) d.idle();
+            continue;
+        }
+
+        _dispatching = true;
+        collect(events.data(), ev_count);
+        for(auto& q : _ready)
+            for(auto [i, ev] : q)
+            {
+                i->state.queued = 0;
+                // Removed earlier in this batch: the record is still there (see reap()), but not to be dispatched.
+                if(i->state.destroy) continue;
+                if(_trace) _trace->event(*i, ev);
+                if(!ev)
+                {
+                    // Carried over from the previous iteration: continuation, no new bytes accounted.
+                    i->pksize = 0;
+                    if(d.read(*i) == rem::end) shutdown();
+                }
+                else dispatch(*i, ev, d);
+                if(_trace) _trace->commit(*i);
+            }
+        // Output queued by the batch (flush()): written once per descriptor, those queued meanwhile are for the next iteration.
+        _flushing.swap(_flush);
+        for(auto* i : _flushing)
+        {
+            i->flow.flush = false;
+            if(!i->state.destroy && d.write(*i) == rem::end) shutdown();
+        }
+        _flushing.clear();
+        reap();
+    }while(!_terminate);
+    reap();
+    end_run();
+    return rem::ok;
+}
+
+
+/*!
+ * \brief listener::dispatch delivers the events \a ev of one ready descriptor through \a d - see loop().
+ */
+template<typename D> void listener::dispatch(ifd& i, uint32_t ev, D& d)
+{
+    // Hangup with stream input pending (pipe writer gone, peer closed after sending): read it first - the end of
+    // stream is then seen as a zero-length read.
+    // Paused or throttled, EPOLLIN is disarmed and the hangup comes alone: the bytes still queued are delivered by one
+    // last read, whatever the pause and the budget, then the descriptor is closed.
+    bool last = (ev & EPOLLHUP) && !(ev & (EPOLLIN | EPOLLERR)) && !(i.options & ifd::O_MSG) && (i.flow.paused || i.flow.throttled);
+    if(last)
+        ev |= EPOLLIN;
+    else if((ev & EPOLLERR) || ((ev & EPOLLHUP) && (!(ev & EPOLLIN) || (i.options & ifd::O_MSG))))
+    {
+        d.close(i);
+        return;
+    }
+    rem::code c = rem::ok;
+    if((ev & EPOLLPRI) && d.urgent(i, c))
+    {
+        if(c == rem::end) shutdown();
+        if(i.state.destroy || !(ev & (EPOLLIN | EPOLLOUT))) return;
+        ev &= ~EPOLLPRI;
+    }
+    if((ev & EPOLLOUT) && (i.options & ifd::O_WRITE))
+    {
+        i.state.readable = false;
+        i.state.writeable = true;
+        if(d.write(i) == rem::end) shutdown();
+        if(i.state.destroy) return;
+    }
+    // Paused meanwhile (by this batch's handlers): the read waits for resume.
+    if((!last && (i.flow.paused || i.flow.throttled)) || !(ev & (EPOLLIN | EPOLLPRI))) return;
+    auto budget = i.budget;
+    if(last) i.budget = 0;
+
+    i.state.readable = true;
+    i.state.writeable = false;
+    if(i.options & ifd::O_MSG)
+    {
+        if(!(i.options & ifd::O_MEM)) i.pksize = 0;
+        c = d.read(i);
+    }
+    else if(!i.toread())
+    {
+        // Zero-length read with the hangup reported: the stream is over - drop it or epoll keeps reporting it.
+        // Without the hangup, d decides (a listening socket reads zero bytes too).
+        i.budget = budget;
+        if(ev & EPOLLHUP) d.close(i);
+        else d.zero(i);
+        return;
+    }
+    else if(i.pksize > i.max_pksize)
+    {
+        rem::push_status(HERE) << rem::overflow << " packet size:" << color::Yellow << i.pksize
+                                 << color::Reset << " max set to " <<  color::Yellow << i.max_pksize
+                                 << color::Reset << " ignoring.";
+        if(!last)
+        {
+            i.budget = budget;
+            return;
+        }
+    }
+    else if(i.options & (ifd::I_AUTOFILL | ifd::O_MEM))
+    {
+        (void)i.fill();
+        c = d.read(i);
+    }
+    else if(i.options & ifd::O_WINDOWED)
+        c = i.window_in() ? d.window(i) : rem::ok;
+    else
+        c = d.read(i);
+
+    if(c == rem::end) shutdown();
+    i.budget = budget;
+    if(last)
+    {
+        if(!i.state.destroy) d.close(i);
+        return;
+    }
+    // Over its budget: the rest is read on the next iteration, after the others had their turn.
+    if(i.state.more && !i.state.destroy) carry(i);
+}
+
+
+/*!
+ * \brief listener::handler_dispatch the io::handler calls of run(H&) - see loop().
+ */
+template<handler H> struct listener::handler_dispatch
+{
+    listener& l;
+    H& h;
 
+    void idle()
+    {
+        if constexpr (requires { h.on_idle(); }) h.on_idle();
+        else l._idle_signal();
+    }
+    rem::code read(ifd& f) { return static_cast<rem::code>(h.on_read(f)); }
+    rem::code write(ifd& f) { return static_cast<rem::code>(h.on_write(f)); }
+    rem::code window(ifd& f)
+    {
+        if constexpr (requires { h.on_window(f); }) return static_cast<rem::code>(h.on_window(f));
+        else return read(f);
+    }
+    bool urgent(ifd& f, rem::code& c)
+    {
+        if constexpr (requires { h.on_urgent(f); })
+        {
+            c = static_cast<rem::code>(h.on_urgent(f));
+            return true;
+        }
+        else return false;
+    }
+    void close(ifd& f)
+    {
+        h.on_close(f);
+        if(!f.state.destroy) (void)l.remove_ifd(f.fd);
+    }
+    void zero(ifd& f)
+    {
+        // A listening socket reads zero bytes when a connection is ready: that is on_read - accept() - not an end of stream.
+        int on = 0;
+        socklen_t len = sizeof(on);
+        if(!::getsockopt(f.fd, SOL_SOCKET, SO_ACCEPTCONN, &on, &len) && on)
+        {
+            if(read(f) == rem::end) l.shutdown();
+            return;
+        }
+        close(f);
+    }
 };
 
 }
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include "iolistener/spsc_ring.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The pipeline class - moves the processing of the connections' data off the listener thread.
+ *
+ * The listener thread (the reactor) reads each connection's bytes into pooled buffers and hands them, as items, to a
+ * worker thread through that worker's spsc_ring. The worker runs the work function on the item - decoding, business
+ * logic - and leaves the response in the same buffer; the item comes back through the worker's return ring, an eventfd
+ * rings the listener and the response is written to the connection on the listener thread. All the i/o stays on the
+ * listener thread.
+ *
+ * A connection has affinity to one worker: its items are processed one at a time and in order, so the work function
+ * may keep per-connection state. A connection with nothing in flight can be moved to an idle worker when its own one
+ * is behind by more than the rebalance depth (see set_rebalance()).
+ *
+ * With workers = 0, the work function runs inline on the listener thread - same path, no handoff.
+ *
+ * The buffers held for a connection - submitted, not yet written back - are accounted in listener::buffered(): with
+ * watermarks (add(fd, high, low)), a connection whose worker is behind stops being read and the pool stays bounded.
+ * A response the connection does not take at once keeps its buffer, queued with the connection's next ones, and is
+ * finished from the connection's write_signal (EPOLLOUT, listener::want_write()) - so does a connection that reads its
+ * responses slowly.
+ */
+class pipeline : public book::object
+{
+public:
+    /*!
+     * \brief item - one chunk of a connection's stream, request in, response out.
+     */
+    struct item
+    {
+        int      fd = -1;
+        uint32_t gen = 0;       ///< connection generation: the response to a closed (or reused) fd is dropped.
+        uint32_t size = 0;      ///< bytes in data: the request, then the response (0 = nothing to write back).
+        uint32_t capacity = 0;  ///< size of the data buffer.
+        uint8_t* data = nullptr;
+    };
+    using work_fn = std::function<void(item&)>;
+
+    struct counters
+    {
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        uint64_t dropped = 0;       ///< responses of connections closed meanwhile.
+        uint64_t short_writes = 0;  ///< responses the connection did not take at once - finished on EPOLLOUT.
+        uint64_t write_errors = 0;  ///< connections closed on a write error.
+        uint64_t migrated = 0;      ///< connections moved to another worker.
+    };
+
+private:
+    struct worker
+    {
+        spsc_ring<item>         in;        ///< listener -> worker
+        spsc_ring<item>         out;       ///< worker -> listener
+        alignas(64) std::atomic<uint32_t> bell{0};
+        std::atomic<bool>       sleeping{false};
+        std::thread             thread;
+        std::deque<item>        backlog;   ///< listener thread: items waiting for room in the in ring.
+        std::size_t             inflight = 0; ///< listener thread.
+        explicit worker(std::size_t ring_size): in(ring_size), out(ring_size) {}
+    };
+
+    struct conn
+    {
+        uint32_t gen = 0;
+        uint32_t inflight = 0;
+        int      worker = -1;
+        bool     open = false;
+        uint32_t sent = 0;          ///< bytes of unsent.front() already written.
+        std::deque<item> unsent;    ///< responses waiting for the connection to take them, in order.
+    };
+
+    work_fn                 _fn;
+    std::size_t             _nworkers;
+    std::size_t             _ring_size;
+    uint32_t                _bufsize;
+    std::size_t             _rebalance = 32;
+    listener*               _listener = nullptr;
+    int                     _efd = -1;
+    std::atomic<bool>       _stop{false};
+    std::atomic<bool>       _rung{false};
+    std::vector<std::unique_ptr<worker>> _workers;
+    std::vector<conn>       _conns;   ///< fd-indexed.
+    std::vector<uint8_t*>   _pool;    ///< free buffers.
+    std::vector<std::unique_ptr<uint8_t[]>> _buffers;
+    counters                _stats;
+
+    void work(worker& w);
+    void wake(worker& w);
+    void ring();
+    uint8_t* take();
+    int  pick(int current);
+    void submit(conn& c, item& it);
+    void complete(item& it);
+    bool write_out(conn& c, int fd);
+    void drop(conn& c, int fd);
+    book::expect<> data_in(ifd& f);
+    book::expect<> data_out(ifd& f);
+    book::expect<> closed(ifd& f);
+    book::expect<> doorbell(ifd& f);
+
+public:
+    explicit pipeline(book::object* parent, work_fn fn, std::size_t workers = 2, std::size_t ring_size = 1024, uint32_t buffer_size = 16 * 1024);
+    ~pipeline() override;
+
+    book::expect<> attach(listener& l);
+    book::expect<> add(int fd, std::size_t high = 0, std::size_t low = 0);
+    book::expect<> stop();
+
+    void set_rebalance(std::size_t depth) { _rebalance = depth; }
+    std::size_t workers() const { return _nworkers; }
+    const counters& stats() const { return _stats; }
+    std::size_t memory() const { return _buffers.size() * _bufsize; } ///< bytes of the buffer pool.
+};
+
+}
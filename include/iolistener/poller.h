@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/ifd.h"
+#include <logbook/expect.h>
+#include <sys/epoll.h>
+
+
+namespace io
+{
+
+/*!
+ * \brief The poller interface - the readiness backend under the listener.
+ *
+ * The listener registers its descriptors here and waits on it; the events come back in epoll's format whatever the
+ * backend: epoll_event::events with the EPOLL* bits, epoll_event::data.ptr the ifd*. The descriptors are level-triggered.
+ * epoll_poller is the default; sim_poller runs the listener over memory descriptors.
+ */
+class poller
+{
+public:
+    virtual ~poller() = default;
+
+    virtual book::expect<> init() = 0;      ///< listener::init().
+    virtual book::expect<> add(ifd& f, uint32_t events) = 0;
+    virtual book::expect<> modify(ifd& f, uint32_t events) = 0;
+    virtual book::expect<> remove(ifd& f) = 0;
+    /*!
+     * \brief wait fills up to \a max events; \a timeout in milliseconds, -1 = infinite, 0 = do not block.
+     * \return number of events, 0 on time-out, -1 on error (errno).
+     */
+    virtual int wait(epoll_event* events, int max, int timeout) = 0;
+    virtual void close_fd(int fd) = 0;      ///< close a descriptor released by the listener ( listener::close_ifd ).
+    virtual void shutdown_fd(int fd) = 0;   ///< listener::shutdown() on each descriptor.
+    virtual void close() = 0;
+    virtual bool simulated() const { return false; } ///< no kernel descriptors: socket options and the like do not apply.
+};
+
+
+/*!
+ * \brief epoll_poller - the linux epoll backend.
+ */
+class epoll_poller : public poller
+{
+    int _fd = -1;
+
+public:
+    epoll_poller() = default;
+    ~epoll_poller() override;
+
+    book::expect<> init() override;
+    book::expect<> add(ifd& f, uint32_t events) override;
+    book::expect<> modify(ifd& f, uint32_t events) override;
+    book::expect<> remove(ifd& f) override;
+    int wait(epoll_event* events, int max, int timeout) override;
+    void close_fd(int fd) override;
+    void shutdown_fd(int fd) override;
+    void close() override;
+};
+
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+
+#include <csignal>
+#include <string>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The process class - a child process driven from the listener thread.
+ *
+ * spawn() starts the child with posix_spawn (vfork-like, no copy of the parent's address space) and non-blocking pipes
+ * on the requested standard streams. Their parent ends are ifd's of the listener: connect to i_fd(out)->read_signal() and
+ * i_fd(err)->read_signal() as for a socket, write() to its stdin. The exit is watched through a pidfd in the listener:
+ * exit_signal() is emitted once the child is reaped - status() then holds its wait status. The output still in the pipes
+ * is read independently of the exit, up to the end of the streams.
+ *
+ * forward() splices a stream of the child straight into a file or socket, without copying it through user space. A full
+ * non-blocking target pauses the stream until it takes more: the child is slowed down by its pipe.
+ *
+ * \note write() to the stdin of a child that closed it raises SIGPIPE: ignore it in the application.
+ * \note With SIGCHLD ignored the kernel reaps the child itself: exit_signal is still emitted, status() is status_lost.
+ * \note The process must be destroyed before its listener. A still running child is killed (SIGKILL) and reaped by the
+ * destructor.
+ */
+class process : public book::object
+{
+public:
+    enum stream : uint8_t
+    {
+        in  = 0x01,
+        out = 0x02,
+        err = 0x04,
+        all = 0x07
+    };
+    static constexpr int status_lost = 0x7fffffff; ///< status() of a child reaped elsewhere (SIGCHLD ignored): unknown.
+
+private:
+    listener*   _listener = nullptr;
+    pid_t       _pid = -1;
+    int         _pidfd = -1;
+    int         _fds[3] = {-1, -1, -1};    ///< parent ends of stdin, stdout, stderr.
+    int         _forward[3] = {-1, -1, -1}; ///< splice targets of stdout, stderr.
+    int         _target[3] = {-1, -1, -1};  ///< dup of the splice targets in the listener, for their write_signal once full.
+    int         _status = -1;
+    book::notify<process&> _exit_signal{"exit"};
+
+    book::expect<> exited(ifd& f);
+    book::expect<> closed(ifd& f);
+    book::expect<> spliced(ifd& f);
+    book::expect<> drained(ifd& f);
+    book::expect<> target_closed(ifd& f);
+    book::expect<> wait_target(int x);
+    void unforward(int x);
+    void abort_spawn();
+    void close_all();
+
+public:
+    process(book::object* parent, const std::string& ii);
+    ~process() override;
+
+    book::expect<> spawn(listener& l, const std::vector<std::string>& argv, const std::vector<std::string>& env = {}, uint8_t pipes = stream::all);
+    book::expect<std::size_t> write(const void* data, std::size_t size);
+    book::expect<> close_stdin();
+    book::expect<> forward(stream s, int to_fd);
+    book::expect<> kill(int sig = SIGTERM);
+
+    ifd* i_fd(stream s);
+    pid_t pid() const { return _pid; }
+    bool running() const { return _pid > 0 && _status < 0; }
+    int status() const { return _status; }
+    book::notify<process&>& exit_signal() { return _exit_signal; }
+};
+
+}
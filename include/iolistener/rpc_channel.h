@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The rpc_channel class - pipelined request/response calls multiplexed over one stream connection.
+ *
+ * Each message is a 12-byte header followed by its payload:
+ *
+ *     size (4) | id (4) | method (2) | kind (1) | status (1)      - network byte order (tcp_socket::toinet)
+ *
+ * call() queues a request with a fresh correlation id and returns at once: any number of calls can be outstanding, the
+ * replies complete them by id, in whatever order the peer sends them. The requests queued during a loop iteration are
+ * written together at its end (listener::flush()); EPOLLOUT is armed only when the socket is full.
+ *
+ * A call with a deadline fails with status::timeout if its reply is not in by then - one timerfd per channel, in the
+ * control priority class, armed to the earliest deadline. A late reply is dropped. When the connection goes away, the
+ * outstanding calls fail with status::closed.
+ *
+ * The same channel serves the requests of the peer: serve() sets the function that receives them; it answers with
+ * reply(), right away or later.
+ *
+ * Callbacks only: completions run on the listener thread, from the read of the reply (or from the timer). The channel
+ * is used from the listener thread only.
+ */
+class rpc_channel : public book::object
+{
+public:
+    static constexpr std::size_t header_size = 12;
+    static constexpr uint32_t max_message = 16 * 1024 * 1024; ///< bigger: protocol error, the connection is closed.
+
+    enum class kind : uint8_t { request = 1, reply = 2 };
+
+    /*!
+     * \brief Reply statuses. The codes up to 0xef are free for the application; the last ones are set locally.
+     */
+    enum status : uint8_t
+    {
+        ok             = 0,
+        failed         = 1,
+        unknown_method = 2,
+        timeout        = 0xfe,  ///< no reply before the deadline.
+        closed         = 0xff   ///< the connection went away (or close()) before the reply.
+    };
+
+    /*!
+     * \brief A message - request for serve(), reply for the call's callback. \a data is valid during the callback only.
+     */
+    struct message
+    {
+        uint32_t id = 0;
+        uint16_t method = 0;
+        uint8_t  status = ok;
+        const uint8_t* data = nullptr;
+        std::size_t size = 0;
+    };
+
+    using reply_fn = std::function<void(const message&)>;
+    using serve_fn = std::function<void(rpc_channel&, const message&)>;
+
+private:
+    struct pending
+    {
+        reply_fn done;
+        uint16_t method = 0;
+        uint64_t deadline = 0;       ///< CLOCK_MONOTONIC ns; 0: none.
+    };
+    struct expiry
+    {
+        uint64_t deadline;
+        uint32_t id;
+        bool operator>(const expiry& e) const { return deadline > e.deadline; }
+    };
+
+    listener*   _listener = nullptr;
+    ifd*        _ifd = nullptr;
+    int         _fd = -1;
+    int         _tfd = -1;                 ///< deadlines timerfd.
+    uint64_t    _armed = 0;                ///< deadline the timerfd is armed to; 0: disarmed.
+    uint32_t    _next_id = 1;
+    uint32_t    _default_timeout_ms = 0;
+    std::unordered_map<uint32_t, pending> _pending;
+    std::priority_queue<expiry, std::vector<expiry>, std::greater<>> _deadlines;
+    std::vector<uint8_t> _in, _out;
+    std::size_t _ipos = 0, _opos = 0;
+    serve_fn    _serve;
+    uint64_t    _calls = 0, _replies = 0, _timeouts = 0, _writes = 0;
+    book::notify<rpc_channel&> _closed_signal{"rpc closed"};
+
+    book::expect<> readable(ifd& f);
+    book::expect<> writable(ifd& f);
+    book::expect<> hangup(ifd& f);
+    book::expect<> expired(ifd& f);
+    void queue(kind k, uint32_t id, uint16_t method, uint8_t st, const void* data, std::size_t size);
+    void dispatch(const uint8_t* h, const uint8_t* data);
+    void arm(uint64_t deadline);
+    void fail_all(uint8_t st);
+
+public:
+    rpc_channel(book::object* parent, const std::string& ii);
+    ~rpc_channel() override;
+
+    book::expect<> attach(listener& l, int fd);
+    book::expect<> close();
+
+    book::expect<uint32_t> call(uint16_t method, const void* data, std::size_t size, reply_fn done, uint32_t timeout_ms = 0);
+    book::expect<> reply(uint32_t id, const void* data, std::size_t size, uint8_t st = ok);
+    void serve(serve_fn fn) { _serve = std::move(fn); }
+    void set_default_timeout(uint32_t ms) { _default_timeout_ms = ms; }
+
+    int fd() const { return _fd; }
+    std::size_t outstanding() const { return _pending.size(); }
+    std::size_t queued_bytes() const { return _out.size() - _opos; }
+    uint64_t calls() const { return _calls; }
+    uint64_t timeouts() const { return _timeouts; }
+    uint64_t writes() const { return _writes; }      ///< send() syscalls - calls()/writes() is the batching factor.
+    book::notify<rpc_channel&>& closed_signal() { return _closed_signal; }
+};
+
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+
+namespace io
+{
+
+/*!
+ * \brief shared_buffer - reference-counted byte buffer, immutable once shared.
+ *
+ * The bytes and the count are one allocation; copying the handle only bumps the count, the last handle released frees
+ * the buffer. Fill it through wdata() before handing it out (see broadcaster::publish()).
+ * \note The count is not atomic: the handles of one buffer are copied and released on one thread - the listener's.
+ */
+class shared_buffer
+{
+    struct block
+    {
+        uint32_t refs;
+        uint32_t size;
+        // the bytes follow.
+    };
+    block* _b = nullptr;
+
+    void release()
+    {
+        if(_b && !--_b->refs) ::operator delete(_b);
+        _b = nullptr;
+    }
+
+public:
+    shared_buffer() = default;
+    explicit shared_buffer(std::size_t size)
+    {
+        _b = static_cast<block*>(::operator new(sizeof(block) + size));
+        _b->refs = 1;
+        _b->size = static_cast<uint32_t>(size);
+    }
+    shared_buffer(const void* data, std::size_t size) : shared_buffer(size)
+    {
+        if(size) std::memcpy(wdata(), data, size);
+    }
+    shared_buffer(const shared_buffer& o) : _b(o._b) { if(_b) ++_b->refs; }
+    shared_buffer(shared_buffer&& o) noexcept : _b(std::exchange(o._b, nullptr)) {}
+    shared_buffer& operator=(const shared_buffer& o)
+    {
+        if(o._b) ++o._b->refs;
+        release();
+        _b = o._b;
+        return *this;
+    }
+    shared_buffer& operator=(shared_buffer&& o) noexcept
+    {
+        if(this != &o)
+        {
+            release();
+            _b = std::exchange(o._b, nullptr);
+        }
+        return *this;
+    }
+    ~shared_buffer() { release(); }
+
+    const uint8_t* data() const { return _b ? reinterpret_cast<const uint8_t*>(_b + 1) : nullptr; }
+    uint8_t* wdata() { return _b ? reinterpret_cast<uint8_t*>(_b + 1) : nullptr; }
+    std::size_t size() const { return _b ? _b->size : 0; }
+    uint32_t use_count() const { return _b ? _b->refs : 0; }
+    explicit operator bool() const { return _b != nullptr; }
+};
+
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/listener.h"
+#include "iolistener/unix_socket.h"
+#include <logbook/expect.h>
+#include <logbook/object.h>
+
+#include <array>
+#include <atomic>
+
+
+namespace io
+{
+
+/*!
+ * \brief The shm_channel class - duplex message transport between two processes of the same host through shared memory.
+ *
+ * Two single producer / single consumer byte rings live in one memfd mapped by both sides; each direction has an eventfd
+ * doorbell. A message is copied once, into the ring, and read in place by the peer - no system call per message.
+ *
+ * The consumer registers its doorbell in the listener (attach()); the ifd read_signal then reads like a non-blocking
+ * socket: recv() until it returns 0. The doorbell is only rung when the consumer went to sleep - recv() found the ring
+ * empty and armed it. A consumer that keeps polling (front()/pop(), without arming) is never rung.
+ *
+ * The side that create()s the channel hands it to the peer with send_to() - memfd and eventfds over SCM_RIGHTS -
+ * and the peer opens it with receive_from().
+ */
+class shm_channel : public book::object
+{
+public:
+    static constexpr std::size_t min_capacity = 4096;
+
+private:
+    /*!
+     * \brief One direction, in the shared memory.
+     */
+    struct ring
+    {
+        alignas(64) std::atomic<uint64_t> head{0};   ///< consumer
+        std::atomic<uint32_t> waiting{0};            ///< consumer asleep: the producer rings the doorbell.
+        alignas(64) std::atomic<uint64_t> tail{0};   ///< producer
+    };
+    struct header
+    {
+        char     magic[8];
+        uint64_t capacity;
+        ring     rings[2];
+    };
+
+    int         _memfd = -1;
+    int         _efd[2] = {-1, -1};   ///< doorbell of rings[0], rings[1].
+    listener*   _listener = nullptr;   ///< attach()'ed to.
+    header*     _hdr = nullptr;
+    std::size_t _maplen = 0;
+    uint64_t    _mask = 0;
+    int         _side = 0;            ///< 0: creator - sends on rings[0]; 1: peer - sends on rings[1].
+    uint8_t*    _tx = nullptr;
+    uint8_t*    _rx = nullptr;
+    uint64_t    _tx_head = 0;         ///< producer's copy of the peer's head.
+    uint64_t    _rx_tail = 0;         ///< consumer's copy of the peer's tail.
+    ifd*        _ifd = nullptr;
+
+    book::expect<> map(std::size_t len);
+    book::expect<> doorbell(ifd& f);
+    ring& tx() { return _hdr->rings[_side]; }
+    ring& rx() { return _hdr->rings[1 - _side]; }
+
+public:
+    shm_channel(object* parent, const std::string& ii);
+    shm_channel();
+    ~shm_channel() override;
+
+    book::expect<> create(std::size_t capacity = 1024 * 1024);
+    book::expect<> open(int memfd, int efd0, int efd1);
+    book::expect<> send_to(unix_socket& s);
+    book::expect<> receive_from(unix_socket& s);
+    book::expect<> attach(listener& l);
+    ifd* i_fd() { return _ifd; }
+    std::array<int, 3> fds() const { return {_memfd, _efd[0], _efd[1]}; }
+    std::size_t capacity() const { return _mask + 1; }
+    std::size_t max_message() const { return capacity() / 4; }
+
+    book::expect<> send(const void* data, std::size_t size);
+    book::expect<std::size_t> recv(void* data, std::size_t size);
+    const uint8_t* front(uint32_t& size);
+    void pop();
+    bool arm();
+};
+
+}
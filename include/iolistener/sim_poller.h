@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/poller.h"
+#include <functional>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief sim_poller - in-process simulated backend: the descriptors are memory pipes, readiness is injected.
+ *
+ * No kernel object behind the descriptors: open() hands out virtual fd numbers (dense, from 3 up - the ifd_table stays
+ * compact), inject() queues bytes on one, hangup()/ready() raise events. The listener and the handlers run unchanged on
+ * top of it, which measures the dispatch, framing and handler layers without syscalls and lets a single process hold a
+ * million connections.
+ *
+ * Contract for the handlers: add() sets ifd::O_MEM on the descriptors. The bytes of a read event are in
+ * ifd::internal_buffer / ifd::pksize (as with I_AUTOFILL) and are consumed by the dispatch - they are valid until the
+ * next wait. Writes go through write(), not ifd::out(): the numbers are not kernel descriptors. Readiness is
+ * level-triggered, as with epoll: pending bytes over the delivery size (or ifd::budget) are delivered on the next waits.
+ *
+ * The poller never blocks: with nothing ready, wait() calls the driver (set_driver()) - the test code that injects the
+ * next load or calls listener::shutdown() - and returns 0 (a time-out for the listener) if it is still idle.
+ * Not thread-safe: inject from the loop thread (driver, handlers).
+ */
+class sim_poller : public poller
+{
+public:
+    sim_poller() = default;
+    ~sim_poller() override = default;
+
+    book::expect<> init() override { return book::rem::ok; }
+    book::expect<> add(ifd& f, uint32_t events) override;
+    book::expect<> modify(ifd& f, uint32_t events) override;
+    book::expect<> remove(ifd& f) override;
+    int wait(epoll_event* events, int max, int timeout) override;
+    void close_fd(int fd) override;
+    void shutdown_fd(int fd) override { hangup(fd); }
+    void close() override {}
+    bool simulated() const override { return true; }
+
+    int  open();
+    bool pair(int fds[2]);
+    book::expect<> inject(int fd, const void* data, std::size_t n);
+    book::expect<> write(int fd, const void* data, std::size_t n);
+    void hangup(int fd);
+    void ready(int fd, uint32_t events);
+    std::vector<uint8_t>* output(int fd);
+    void set_driver(std::function<void()> fn) { _driver = std::move(fn); }
+    void set_delivery_size(std::size_t n) { _chunk = n ? n : 1; }
+
+    std::size_t open_count() const { return _open; }
+    uint64_t delivered_bytes() const { return _bytes; }
+    uint64_t delivered_events() const { return _events; }
+
+    static constexpr int first_fd = 3;
+
+private:
+    /*!
+     * \brief A virtual descriptor. \a cur holds the bytes being delivered - never resized during a batch, so the
+     * ifd::internal_buffer pointers stay valid; inject() appends to \a in, swapped in once \a cur is consumed.
+     */
+    struct entry
+    {
+        ifd*        f = nullptr;      ///< registered record; nullptr: not in the poll set.
+        uint32_t    mask = 0;         ///< registered events.
+        uint32_t    raised = 0;       ///< events raised by ready(), reported once.
+        int         peer = -1;        ///< pair(): write() injects there; -1: write() goes to out.
+        bool        used = false;
+        bool        hup = false;
+        bool        queued = false;
+        std::size_t head = 0;         ///< delivered bytes of cur.
+        std::size_t given = 0;        ///< bytes delivered by the wait number \a batch.
+        uint64_t    batch = 0;        ///< last wait that reported the descriptor.
+        std::vector<uint8_t> cur, in, out;
+
+        std::size_t pending() const { return cur.size() - head + in.size(); }
+    };
+
+    entry* query(int fd);
+    uint32_t readiness(const entry& e) const;
+    void enqueue(int fd, entry& e);
+
+    std::vector<entry> _fds;          ///< index: fd - first_fd.
+    std::vector<int> _free;
+    std::vector<int> _queue;          ///< descriptors that may be ready, in order.
+    std::size_t _qhead = 0;
+    std::size_t _chunk = 64 * 1024;   ///< bytes delivered per read event.
+    std::size_t _open = 0;
+    uint64_t _batch = 0;              ///< wait() count.
+    uint64_t _bytes = 0, _events = 0;
+    std::function<void()> _driver;
+};
+
+}
@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+namespace io
+{
+
+/*!
+ * \brief spsc_ring - bounded lock-free single producer / single consumer queue.
+ *
+ * One thread push()es, one other thread pop()s. The capacity is rounded up to a power of two. Each side keeps a cached
+ * copy of the other side's index, so the shared cache lines are only read when the ring looks full (producer) or empty
+ * (consumer).
+ */
+template<typename T> class spsc_ring
+{
+public:
+    explicit spsc_ring(std::size_t capacity)
+    {
+        std::size_t c = 2;
+        while(c < capacity) c <<= 1;
+        _mask = c - 1;
+        _slots.reset(new T[c]);
+    }
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    /*!
+     * \brief push producer side.
+     * \return false if the ring is full.
+     */
+    bool push(const T& v)
+    {
+        auto t = _tail.load(std::memory_order_relaxed);
+        if(t - _head_cache > _mask)
+        {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if(t - _head_cache > _mask) return false;
+        }
+        _slots[t & _mask] = v;
+        _tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * \brief pop consumer side.
+     * \return false if the ring is empty.
+     */
+    bool pop(T& v)
+    {
+        auto h = _head.load(std::memory_order_relaxed);
+        if(h == _tail_cache)
+        {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if(h == _tail_cache) return false;
+        }
+        v = _slots[h & _mask];
+        _head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * \brief size - a snapshot, exact only from the consumer or the producer thread while the other side is idle.
+     */
+    std::size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+    std::size_t capacity() const { return _mask + 1; }
+
+private:
+    std::unique_ptr<T[]> _slots;
+    std::size_t _mask = 0;
+    alignas(64) std::atomic<std::size_t> _head{0}; ///< consumer
+    std::size_t _tail_cache = 0;                  ///< consumer's copy of _tail
+    alignas(64) std::atomic<std::size_t> _tail{0}; ///< producer
+    std::size_t _head_cache = 0;                  ///< producer's copy of _head
+};
+
+}
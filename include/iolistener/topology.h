@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include <logbook/expect.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief The topology class - cpus and NUMA nodes of the machine, and the placement primitives of the listener threads
+ * and their memory.
+ *
+ * load() reads /sys/devices/system/node; a kernel without NUMA gives one node holding all the cpus. irq_cpus() gives the
+ * cpus that take the interrupts of a network interface (its MSI vectors): reactors placed there, and connections handed
+ * to the reactor of their incoming_cpu(), keep the packets, the socket and the handler on one cpu and one node.
+ *
+ * The memory calls are the raw mbind/set_mempolicy system calls - no libnuma.
+ */
+class topology
+{
+    std::vector<int> _node_of;                 ///< cpu -> node.
+    std::vector<std::vector<int>> _cpus;       ///< node -> cpus.
+
+public:
+    topology() = default;
+
+    book::expect<> load();
+    std::size_t node_count() const { return _cpus.size(); }
+    std::size_t cpu_count() const { return _node_of.size(); }
+    int node_of(int cpu) const;
+    const std::vector<int>& cpus(int node) const;
+
+    static std::vector<int> parse_cpulist(const std::string& list);
+    static std::vector<int> irq_cpus(const std::string& ifname);
+    static book::expect<int> incoming_cpu(int fd);
+    static int current_cpu();
+
+    static book::expect<> pin(pthread_t thread, int cpu);
+    static book::expect<> prefer_node(int node);
+    static book::expect<> bind(void* addr, std::size_t size, int node, bool move = true);
+    static void* alloc(std::size_t size, int node);
+    static void release(void* addr, std::size_t size);
+};
+
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "iolistener/ifd_table.h"
+#include <logbook/expect.h>
+#include <string>
+#include <vector>
+
+
+namespace io
+{
+
+/*!
+ * \brief io trace file layout: a file_header then the records, each followed by its payload padded to 8 bytes.
+ */
+namespace trace
+{
+
+struct file_header
+{
+    char     magic[8];       ///< "IOTRACE1"
+    uint32_t version;
+    uint32_t record_size;    ///< sizeof(trace::record)
+    uint64_t start_ns;       ///< CLOCK_REALTIME at the start of the recording.
+    uint64_t end;            ///< offset past the last complete record - updated at each append.
+};
+
+struct record
+{
+    uint64_t ns;             ///< time since the start of the recording.
+    int32_t  fd;
+    uint32_t events;         ///< epoll event mask; 0: continuation dispatch of a carried descriptor ( listener::carry ).
+    uint32_t bytes;          ///< bytes pending on the descriptor (FIONREAD) at the event.
+    uint32_t size;           ///< payload bytes following this record: what the dispatch consumed, up to max_payload.
+};
+
+inline std::size_t padded(std::size_t sz) { return (sz + 7) & ~std::size_t(7); }
+
+}
+
+
+/*!
+ * \brief The trace_writer class - records the listener events into a memory-mapped, append-only file.
+ *
+ * Hand it to listener::set_trace(). For each event the record (timestamp, fd, epoll mask, pending bytes) is appended to
+ * the mapping with up to max_payload bytes of the pending data, peeked (MSG_PEEK) from the socket before the dispatch -
+ * nothing is consumed from the descriptor - and cut after it to what the dispatch consumed: the bytes a handler leaves
+ * in a stream socket go with the event that reads them, each byte is recorded once (see commit() for how exact that
+ * is). The file grows by doubling; the
+ * header keeps the end offset so a trace from a process that died is still readable.
+ */
+class trace_writer
+{
+    int         _fd = -1;
+    uint8_t*    _map = nullptr;
+    std::size_t _capacity = 0;
+    std::size_t _end = 0;
+    uint64_t    _t0 = 0;
+    uint32_t    _max_payload;
+    uint64_t    _records = 0;
+
+    // The event between event() and commit():
+    trace::record        _rec{};
+    bool                 _open = false;
+    bool                 _stream = false;   ///< stream socket: the payload is cut to the consumed bytes.
+    std::vector<uint8_t> _peek, _left;
+
+    bool grow(std::size_t need);
+    uint32_t consumed(int fd, uint32_t c);
+
+public:
+    explicit trace_writer(uint32_t max_payload = ifd::autofill_size);
+    trace_writer(const trace_writer&) = delete;
+    ~trace_writer();
+
+    book::expect<> open(const std::string& path, std::size_t capacity = 64 * 1024 * 1024);
+    book::expect<> close();
+    bool is_open() const { return _map != nullptr; }
+
+    void event(ifd& f, uint32_t events);
+    void commit(ifd& f);
+    void append(int fd, uint32_t events, const void* data, uint32_t size, uint32_t bytes);
+
+    uint64_t records() const { return _records; }
+    std::size_t size() const { return _end; }
+};
+
+
+/*!
+ * \brief The trace_replay class - plays a trace back through the ifd handlers, without any real descriptor.
+ *
+ * Set the descriptors up with add() (same fd numbers as in the trace) and connect their signals as for a listener; play()
+ * then hands each EPOLLIN (or continuation) record payload to read_signal the way I_AUTOFILL does - in ifd::internal_buffer / ifd::pksize,
+ * zero-copy from the (copy-on-write) mapping - EPOLLOUT to write_signal and hangups to zero_signal.
+ */
+class trace_replay
+{
+    int         _fd = -1;
+    uint8_t*    _map = nullptr;
+    std::size_t _size = 0;
+    ifd_table   _ifds;
+
+public:
+    trace_replay() = default;
+    trace_replay(const trace_replay&) = delete;
+    ~trace_replay();
+
+    book::expect<> open(const std::string& path);
+    ifd* add(int fd_, uint32_t opt_ = ifd::O_READ);
+    ifd* query_fd(int fd_) { return _ifds.query(fd_); }
+
+    book::expect<uint64_t> play(double speed = 0);
+};
+
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <logbook/notify.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include <memory>
+#include <vector>
+
+#include "iolistener/listener.h"
+
+
+namespace io
+{
+
+/*!
+ * \brief The udp_socket class - batched datagram socket.
+ *
+ * Receives up to batch_count() datagrams per recvmmsg() call into one pooled buffer, and sends batches with sendmmsg().
+ * With GRO enabled the kernel may coalesce several datagrams of one flow into one slot; they are split back into
+ * separate views here. attach() registers the socket into a listener; each read event delivers the received batch to the
+ * batch_signal() handlers.
+ *
+ * \note The datagram views point into the pool: they are valid until the next receive().
+ */
+class udp_socket : public book::object
+{
+public:
+
+    struct datagram
+    {
+        uint8_t*                data = nullptr;
+        std::size_t             size = 0;
+        const sockaddr_storage* from = nullptr;  ///< source address on receive; destination on send (nullptr: connected peer).
+        socklen_t               fromlen = 0;
+        using batch = std::vector<datagram>;
+    };
+
+    using batch = datagram::batch;
+
+    static constexpr std::size_t default_batch = 64;
+    static constexpr std::size_t default_slot  = 2048;     ///< enough for an ethernet MTU datagram.
+    static constexpr std::size_t gro_slot      = 65535;    ///< maximum size of a GRO-coalesced slot.
+
+private:
+    int                     m_fd = -1;
+    int                     m_family = AF_INET;
+    ifd*                    m_ifd = nullptr;
+    listener*               m_listener = nullptr;
+    bool                    m_gro = false;
+    std::size_t             m_count = 0;
+    std::size_t             m_slot = 0;
+
+    std::unique_ptr<uint8_t[]>      m_pool;
+    std::vector<mmsghdr>            m_rx;
+    std::vector<iovec>              m_rxiov;
+    std::vector<sockaddr_storage>   m_rxaddr;
+    std::vector<uint8_t>            m_rxcmsg;
+    std::vector<mmsghdr>            m_tx;
+    std::vector<iovec>              m_txiov;
+    batch                           m_batch;
+
+    uint64_t m_datagrams = 0;
+    uint64_t m_calls = 0;
+
+    book::notify<batch&> _batch_signal{"udp batch"};
+
+    book::expect<> data_in(ifd& f);
+    book::expect<socklen_t> mkaddr(const std::string& addr, sockaddr_storage& a, bool passive) const;
+
+public:
+    udp_socket(object* parent, const std::string& ii);
+    udp_socket();
+    ~udp_socket() override;
+
+    int create(int family = AF_INET);
+    int fd() const { return m_fd; }
+    ifd* i_fd() { return m_ifd; }
+
+    book::expect<> bind(const std::string& addr);
+    book::expect<> connect(const std::string& addr);
+    uint16_t port() const;
+
+    book::expect<> set_batch(std::size_t count, std::size_t slot_size);
+    std::size_t batch_count() const { return m_count; }
+    book::expect<> enable_gro();
+    bool gro() const { return m_gro; }
+
+    book::expect<> attach(listener& l);
+    book::expect<std::size_t> receive();
+    book::expect<std::size_t> send(const datagram* d, std::size_t n);
+    book::expect<std::size_t> send_segmented(const uint8_t* data, std::size_t size, uint16_t segment,
+                                             const sockaddr_storage* to = nullptr, socklen_t tolen = 0);
+
+    book::notify<batch&>& batch_signal() { return _batch_signal; }
+    uint64_t datagrams() const { return m_datagrams; }
+    uint64_t calls() const { return m_calls; }
+};
+
+}
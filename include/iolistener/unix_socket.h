@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#pragma once
+#include <logbook/expect.h>
+#include <logbook/object.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <vector>
+
+#include "iolistener/listener.h"
+
+
+namespace io
+{
+
+/*!
+ * \brief The unix_socket class - AF_UNIX stream or seqpacket socket.
+ *
+ * A path starting with '@' is taken in the abstract namespace (no file on disk, gone with the last descriptor).
+ * send_fds()/recv_fds() pass open file descriptors to the peer process with SCM_RIGHTS - for example an acceptor handing
+ * accepted connections to its workers. Up to max_fds descriptors ride along one message.
+ *
+ * Nothing blocks: a message cut by a full stream socket is kept in the socket and finished later - the rest of a send
+ * from the write_signal once attach()'ed (or flush()), the rest of a receive by the next recv_fds().
+ */
+class unix_socket : public book::object
+{
+public:
+    enum class type : int
+    {
+        stream    = SOCK_STREAM,
+        seqpacket = SOCK_SEQPACKET
+    };
+
+    static constexpr std::size_t max_fds = 253; ///< SCM_MAX_FD of the kernel.
+    static constexpr std::size_t closed = ~std::size_t(0); ///< recv_fds(): the peer closed the connection.
+
+private:
+    int         m_fd = -1;
+    type        m_type = type::stream;
+    std::string m_path;
+    bool        m_listening = false;
+    ifd*        m_ifd = nullptr;
+    listener*   m_listener = nullptr;
+    std::vector<char> m_out;        ///< unsent tail of the last message.
+    std::vector<char> m_in;         ///< received part of a cut message...
+    std::size_t m_in_size = 0;      ///< ...of that size,
+    std::vector<int> m_in_fds;      ///< and the descriptors it carried.
+
+    static socklen_t mkaddr(const std::string& path, sockaddr_un& addr);
+    book::expect<> writable(ifd& f);
+
+public:
+    unix_socket(object* parent, const std::string& ii, type t = type::stream);
+    unix_socket();
+    ~unix_socket() override;
+
+    int create();
+    void set_sockfd(int fd, type t = type::stream);
+    int fd() const { return m_fd; }
+    ifd* i_fd() { return m_ifd; }
+    const std::string& path() const { return m_path; }
+
+    book::expect<> bind(const std::string& path, int backlog = SOMAXCONN);
+    book::expect<> connect(const std::string& path);
+    book::expect<int> accept();
+    static book::expect<> pair(unix_socket& a, unix_socket& b, type t = type::stream);
+
+    book::expect<> attach(listener& l, uint32_t opt_ = ifd::O_READ);
+
+    book::expect<std::size_t> send_fds(const int* fds, std::size_t n, const void* data = nullptr, std::size_t size = 0);
+    book::expect<std::size_t> recv_fds(std::vector<int>& fds, void* data = nullptr, std::size_t size = 0);
+    book::expect<std::size_t> flush();
+    std::size_t pending() const { return m_out.size(); } ///< bytes of a cut message not sent yet.
+};
+
+}
@@ -0,0 +1,293 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/broadcaster.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+constexpr int max_iov = 64; ///< messages gathered per sendmsg().
+}
+
+
+broadcaster::broadcaster(object *parent, const std::string &ii, listener &l) : broadcaster(parent, ii, l, limits{}) {}
+
+
+broadcaster::broadcaster(object *parent, const std::string &ii, listener &l, limits lim) : object(parent, ii),
+    _listener(&l), _limits(lim)
+{}
+
+
+/*!
+ * \note The broadcaster must be destroyed before its listener.
+ */
+broadcaster::~broadcaster()
+{
+    while(!_subs.empty()) (void)unsubscribe(_subs.back().fd);
+    _dropped_signal.disconnect_all();
+}
+
+
+broadcaster::subscriber *broadcaster::query(int fd)
+{
+    if(fd < 0 || static_cast<std::size_t>(fd) >= _index.size() || !_index[fd]) return nullptr;
+    return &_subs[_index[fd] - 1];
+}
+
+
+void broadcaster::index(int fd, int x)
+{
+    if(static_cast<std::size_t>(fd) >= _index.size()) _index.resize(static_cast<std::size_t>(fd) + 1, 0);
+    _index[fd] = x;
+}
+
+
+/*!
+ * \brief broadcaster::subscribe adds \a fd to the subscribers. A descriptor not yet in the listener is added to it,
+ * write-only (EPOLLIN paused). One already there keeps its ifd and read handlers untouched: its EPOLLOUT is watched
+ * through a dup of it, added the same way.
+ */
+expect<> broadcaster::subscribe(int fd)
+{
+    if(query(fd))
+        return rem::push_error(HERE) << " fd " << fd << " already subscribed";
+    bool added = !_listener->query_fd(fd);
+    int wfd = fd;
+    if(!added)
+    {
+        wfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if(wfd < 0) return rem::push_error(HERE) << " dup(" << fd << "): " << std::strerror(errno);
+    }
+    if(auto R = _listener->add_ifd(wfd, ifd::O_WRITE); !R)
+    {
+        if(!added) ::close(wfd);
+        return R;
+    }
+    (void)_listener->pause_ifd(wfd);
+    auto* f = _listener->query_fd(wfd);
+    f->write_signal().connect(this, &broadcaster::writable);
+    f->zero_signal().connect(this, &broadcaster::hangup);
+
+    subscriber s;
+    s.fd = fd;
+    s.wfd = wfd;
+    s.added = added;
+    int type;
+    socklen_t len = sizeof(type);
+    s.socket = getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0;
+    _subs.push_back(std::move(s));
+    index(fd, static_cast<int>(_subs.size()));
+    index(wfd, static_cast<int>(_subs.size()));
+    return rem::ok;
+}
+
+
+/*!
+ * \brief broadcaster::unsubscribe releases the queue of \a fd and the ifd carrying the broadcaster's slots - with them:
+ * \a fd taken out of the listener if subscribe() put it there, its dup closed otherwise. \a fd is not closed.
+ */
+expect<> broadcaster::unsubscribe(int fd)
+{
+    auto* s = query(fd);
+    if(!s || s->fd != fd)
+        return rem::push_error(HERE) << " fd " << fd << " not subscribed";
+    if(_listener->query_fd(s->wfd)) (void)(s->added ? _listener->remove_ifd(s->wfd) : _listener->close_ifd(s->wfd));
+    else if(!s->added) ::close(s->wfd);
+    auto x = _index[fd] - 1;
+    _index[fd] = 0;
+    _index[s->wfd] = 0;
+    if(static_cast<std::size_t>(x) != _subs.size() - 1)
+    {
+        _subs[x] = std::move(_subs.back());
+        _index[_subs[x].fd] = x + 1;
+        _index[_subs[x].wfd] = x + 1;
+    }
+    _subs.pop_back();
+    return rem::ok;
+}
+
+
+/*!
+ * \brief broadcaster::publish queues \a b on every subscriber, written at the end of the loop iteration.
+ * \param key conflation key (policy::conflate); 0: none.
+ * \return the number of subscribers the message was queued on - conflated ones included, dropped ones not.
+ */
+expect<std::size_t> broadcaster::publish(const shared_buffer &b, uint32_t key)
+{
+    if(!b)
+        return rem::push_error(HERE) << " null buffer";
+    ++_stats.published;
+    std::size_t n = 0;
+    for(auto& s : _subs)
+    {
+        if(s.queue.size() >= _limits.max_messages || s.bytes + b.size() > _limits.max_bytes)
+        {
+            if(_limits.slow == policy::disconnect)
+            {
+                _slow.push_back(s.fd);
+                continue;
+            }
+            if(make_room(s, b, key))
+            {
+                ++n;
+                continue;
+            }
+            if(s.queue.size() >= _limits.max_messages || s.bytes + b.size() > _limits.max_bytes) ++_stats.overrun;
+        }
+        s.queue.push_back({b, key});
+        s.bytes += b.size();
+        ++n;
+        if(auto* f = _listener->query_fd(s.wfd)) _listener->flush(*f);
+    }
+    _stats.queued += n;
+    for(auto fd : _slow) drop(fd);
+    _slow.clear();
+    return n;
+}
+
+
+/*!
+ * \brief broadcaster::make_room applies the drop_oldest / conflate policy to the full queue of \a s. The front message,
+ * if partially sent, is never dropped: the stream would be cut in the middle of it.
+ * \return true if \a b replaced a queued message of the same key (conflated): nothing to append.
+ */
+bool broadcaster::make_room(subscriber &s, const shared_buffer &b, uint32_t key)
+{
+    std::size_t start = s.offset ? 1 : 0;
+    if(_limits.slow == policy::conflate && key)
+    {
+        for(auto x = start; x < s.queue.size(); x++)
+        {
+            auto& it = s.queue[x];
+            if(it.key != key) continue;
+            s.bytes = s.bytes - it.buffer.size() + b.size();
+            it.buffer = b;
+            ++_stats.conflated;
+            return true;
+        }
+    }
+    while((s.queue.size() >= _limits.max_messages || s.bytes + b.size() > _limits.max_bytes) && s.queue.size() > start)
+    {
+        auto it = s.queue.begin() + static_cast<std::ptrdiff_t>(start);
+        s.bytes -= it->buffer.size();
+        s.queue.erase(it);
+        ++_stats.dropped;
+    }
+    return false;
+}
+
+
+/*!
+ * \brief broadcaster::writable sends the queue of the subscriber - at the end of the iteration that queued to it, and on
+ * EPOLLOUT while its socket is full.
+ */
+expect<> broadcaster::writable(ifd &f)
+{
+    auto* s = query(f.fd);
+    if(!s) return rem::ok;
+    iovec iov[max_iov];
+    while(!s->queue.empty())
+    {
+        int count = 0;
+        std::size_t total = 0;
+        for(auto it = s->queue.begin(); it != s->queue.end() && count < max_iov; ++it, ++count)
+        {
+            std::size_t skip = count ? 0 : s->offset;
+            iov[count].iov_base = const_cast<uint8_t*>(it->buffer.data()) + skip;
+            iov[count].iov_len = it->buffer.size() - skip;
+            total += iov[count].iov_len;
+        }
+        ssize_t n;
+        if(s->socket)
+        {
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = static_cast<std::size_t>(count);
+            n = ::sendmsg(s->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        else
+            n = ::writev(s->fd, iov, count);
+        ++_stats.syscalls;
+        if(n < 0)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if(!f.flow.want_out) (void)_listener->want_write(s->wfd, true);
+                return rem::ok;
+            }
+            if(errno == ENOTSOCK && s->socket)
+            {
+                s->socket = false;
+                continue;
+            }
+            rem::push_error(HERE) << " fd " << s->fd << ": " << std::strerror(errno) << " - dropping the subscriber";
+            drop(s->fd);
+            return rem::ok;
+        }
+        auto left = static_cast<std::size_t>(n);
+        _stats.sent_bytes += left;
+        s->bytes -= left;
+        while(left)
+        {
+            auto rest = s->queue.front().buffer.size() - s->offset;
+            if(left < rest)
+            {
+                s->offset += left;
+                break;
+            }
+            left -= rest;
+            s->offset = 0;
+            s->queue.pop_front();
+        }
+        // Short write: the socket is full, no need to hit EAGAIN to know it.
+        if(static_cast<std::size_t>(n) < total)
+        {
+            if(!f.flow.want_out) (void)_listener->want_write(s->wfd, true);
+            return rem::ok;
+        }
+    }
+    if(f.flow.want_out) (void)_listener->want_write(s->wfd, false);
+    return rem::ok;
+}
+
+
+expect<> broadcaster::hangup(ifd &f)
+{
+    if(auto* s = query(f.fd)) drop(s->fd);
+    return rem::ok;
+}
+
+
+void broadcaster::drop(int fd)
+{
+    (void)unsubscribe(fd);
+    ++_stats.disconnected;
+    _dropped_signal(fd);
+}
+
+
+std::size_t broadcaster::queued(int fd)
+{
+    return subscribed(fd) ? query(fd)->queue.size() : 0;
+}
+
+}
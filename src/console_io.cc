@@ -73,9 +73,9 @@ expect<> console_io::idle()
     return _idle_signal();
 }
 
-console_io::console_io(): object(nullptr, "console_io") { }
+console_io::console_io(): object(nullptr, "console_io"), io_listener(this, 1000) { }
 
-console_io::console_io(object *parent_obj):object(parent_obj,"console_io") { }
+console_io::console_io(object *parent_obj):object(parent_obj,"console_io"), io_listener(this, 1000) { }
 
 console_io::~console_io()
 {
@@ -86,11 +86,12 @@ console_io::~console_io()
 /*!
  * \brief console_io::begin console_io initializing routine.
  *
- *     Creates the input-loop thread.
+ *     Creates the input-loop thread - pinned to \a cpu, its memory on the node of that cpu, if cpu >= 0
+ *     (see listener::set_placement()).
  *
  * \return
  */
-rem::code console_io::start()
+rem::code console_io::start(int cpu)
 {
     struct winsize win;
 
@@ -110,11 +111,16 @@ rem::code console_io::start()
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
         //... To be continued
 
-    io_listener = listener(this, 1000);
     (void)io_listener.add_ifd(STDIN_FILENO, ifd::O_READ| ifd::I_AUTOFILL);
     auto i = io_listener.query_fd(STDIN_FILENO);
-    i->read_signal.connect(this, &console_io::key_in);
+    i->read_signal().connect(this, &console_io::key_in);
     io_listener.idle_signal().connect(this, &console_io::idle);
+    if(cpu >= 0)
+    {
+        listener::placement p;
+        p.cpu = cpu;
+        (void)io_listener.set_placement(p);
+    }
     rem::push_info(HERE) << color::DarkGreen << "starting the io loop thread :";
     io_thread = std::thread([this](){
         auto e = io_listener.run();
@@ -0,0 +1,246 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+
+#include "iolistener/file_engine.h"
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+file_engine::file_engine(object* parent, std::size_t threads, std::size_t chunk_size):
+    object(parent, "file_engine"), _chunk(chunk_size ? chunk_size : 1024 * 1024), _nthreads(threads ? threads : 1)
+{
+}
+
+file_engine::~file_engine()
+{
+    (void)stop();
+    _completion_signal.disconnect_all();
+    // Registered: the listener drops the ifd (and its slot into this engine) with the fd.
+    if(_listener && _listener->query_fd(_efd)) (void)_listener->close_ifd(_efd);
+    else if(_efd >= 0) ::close(_efd);
+}
+
+
+/*!
+ * \brief file_engine::attach creates the completion eventfd, registers it into \a l and starts the threads.
+ */
+expect<> file_engine::attach(listener& l)
+{
+    if(_efd >= 0) return rem::push_error(HERE) << " file_engine already attached";
+    _efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(_efd < 0) return rem::push_error(HERE) << " eventfd: " << std::strerror(errno);
+    auto R = l.add_ifd(_efd, ifd::O_READ | ifd::O_MSG);
+    if(!R) return R;
+    l.query_fd(_efd)->read_signal().connect(this, &file_engine::doorbell);
+    _listener = &l;
+    _stop = false;
+    for(std::size_t x = 0; x < _nthreads; x++)
+        _threads.emplace_back(&file_engine::worker, this);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief file_engine::stop lets the threads finish the queued requests and joins them. Undelivered completions are dropped;
+ * the requests submitted afterwards are rejected.
+ */
+expect<> file_engine::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(_qmtx);
+        _stop = true;
+    }
+    _qcv.notify_all();
+    for(auto& t : _threads) t.join();
+    _threads.clear();
+    return rem::ok;
+}
+
+
+expect<int> file_engine::open(const std::string& path, int flags, bool direct, mode_t mode)
+{
+    if(direct) flags |= O_DIRECT;
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+    if(fd < 0 && direct && errno == EINVAL)
+    {
+        // tmpfs and a few others do not do O_DIRECT: buffered then.
+        rem::push_warning(HERE) << " " << path << ": no O_DIRECT on this filesystem";
+        fd = ::open(path.c_str(), (flags & ~O_DIRECT) | O_CLOEXEC, mode);
+    }
+    if(fd < 0) return rem::push_error(HERE) << " open(" << path << "): " << std::strerror(errno);
+    return fd;
+}
+
+
+/*!
+ * \brief file_engine::alloc buffer aligned for O_DIRECT; \a size is rounded up to file_engine::alignment.
+ */
+uint8_t* file_engine::alloc(std::size_t size)
+{
+    void* p = nullptr;
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if(posix_memalign(&p, alignment, size)) return nullptr;
+    return static_cast<uint8_t*>(p);
+}
+
+
+void file_engine::release(uint8_t* buffer)
+{
+    std::free(buffer);
+}
+
+
+expect<> file_engine::submit(request_ptr r)
+{
+    if(_efd < 0) return rem::push_error(HERE) << " file_engine not attached to a listener";
+    {
+        std::lock_guard<std::mutex> lk(_qmtx);
+        // Stopped: no thread would run it, its completion would never come.
+        if(_stop) return rem::push_error(HERE) << " file_engine stopped";
+        _queue.push_back(std::move(r));
+    }
+    ++_pending;
+    _qcv.notify_one();
+    return rem::ok;
+}
+
+
+expect<> file_engine::read(int fd, uint64_t offset, uint8_t* data, std::size_t size, request::done_fn done, uint64_t user)
+{
+    auto r = std::make_unique<request>();
+    r->what = op::read;
+    r->fd = fd;
+    r->offset = offset;
+    r->data = data;
+    r->size = size;
+    r->user = user;
+    r->done = std::move(done);
+    return submit(std::move(r));
+}
+
+
+/*!
+ * \brief file_engine::write \a data must stay untouched until the completion.
+ */
+expect<> file_engine::write(int fd, uint64_t offset, const uint8_t* data, std::size_t size, request::done_fn done, uint64_t user)
+{
+    auto r = std::make_unique<request>();
+    r->what = op::write;
+    r->fd = fd;
+    r->offset = offset;
+    r->data = const_cast<uint8_t*>(data);
+    r->size = size;
+    r->user = user;
+    r->done = std::move(done);
+    return submit(std::move(r));
+}
+
+
+expect<> file_engine::fsync(int fd, request::done_fn done, uint64_t user)
+{
+    auto r = std::make_unique<request>();
+    r->what = op::fsync;
+    r->fd = fd;
+    r->user = user;
+    r->done = std::move(done);
+    return submit(std::move(r));
+}
+
+
+void file_engine::worker()
+{
+    while(true)
+    {
+        request_ptr r;
+        {
+            std::unique_lock<std::mutex> lk(_qmtx);
+            _qcv.wait(lk, [this]{ return _stop || !_queue.empty(); });
+            if(_queue.empty()) return; // stopping, and nothing left.
+            r = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        execute(*r);
+        bool ring;
+        {
+            std::lock_guard<std::mutex> lk(_dmtx);
+            ring = _done.empty(); // the doorbell is already rung for a non-empty queue.
+            _done.push_back(std::move(r));
+        }
+        if(ring)
+        {
+            uint64_t one = 1;
+            (void)::write(_efd, &one, sizeof(one));
+        }
+    }
+}
+
+
+/*!
+ * \brief file_engine::execute the blocking part, on a pool thread: chunked pread/pwrite until done, end of file or error.
+ */
+void file_engine::execute(request& r)
+{
+    if(r.what == op::fsync)
+    {
+        if(::fdatasync(r.fd) < 0) r.error = errno;
+        return;
+    }
+    while(r.bytes < r.size)
+    {
+        auto len = std::min(_chunk, r.size - r.bytes);
+        auto off = static_cast<off_t>(r.offset + r.bytes);
+        auto n = r.what == op::read ? ::pread(r.fd, r.data + r.bytes, len, off)
+                                    : ::pwrite(r.fd, r.data + r.bytes, len, off);
+        if(n < 0)
+        {
+            if(errno == EINTR) continue;
+            r.error = errno;
+            return;
+        }
+        if(!n) return; // end of file.
+        r.bytes += static_cast<std::size_t>(n);
+    }
+}
+
+
+/*!
+ * \brief file_engine::doorbell listener thread: delivers the completed requests.
+ */
+expect<> file_engine::doorbell(ifd& f)
+{
+    uint64_t n;
+    (void)::read(f.fd, &n, sizeof(n));
+    {
+        std::lock_guard<std::mutex> lk(_dmtx);
+        _ready.swap(_done);
+    }
+    for(auto& r : _ready)
+    {
+        --_pending;
+        if(r->done) r->done(*r);
+        (void)_completion_signal(*r);
+    }
+    _ready.clear();
+    return rem::ok;
+}
+
+}
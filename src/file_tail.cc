@@ -0,0 +1,247 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/file_tail.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+constexpr uint32_t file_events = IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF;
+constexpr uint32_t dir_events  = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+}
+
+
+file_tail::file_tail(object* parent): object(parent, "file_tail")
+{
+}
+
+file_tail::~file_tail()
+{
+    _rotated_signal.disconnect_all();
+    for(auto& t : _files)
+        if(t->f.fd >= 0) ::close(t->f.fd);
+    // Registered: the listener drops the ifd (and its slot into this tail) with the fd.
+    if(_listener && _listener->query_fd(_fd)) (void)_listener->close_ifd(_fd);
+    else if(_fd >= 0) ::close(_fd);
+}
+
+
+/*!
+ * \brief file_tail::attach creates the inotify descriptor and registers it into \a l.
+ */
+expect<> file_tail::attach(listener& l)
+{
+    if(_fd >= 0) return rem::push_error(HERE) << " file_tail already attached";
+    _fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(_fd < 0) return rem::push_error(HERE) << " inotify_init1: " << std::strerror(errno);
+    auto R = l.add_ifd(_fd, ifd::O_READ | ifd::O_MSG);
+    if(!R) return R;
+    l.query_fd(_fd)->read_signal().connect(this, &file_tail::events);
+    _listener = &l;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief file_tail::watch starts following \a path - from its current end, or from its start with \a from_start.
+ * \return the ifd of the file: connect its read_signal (or share_handlers()). Stable until unwatch().
+ * \note One watch per file: two paths to the same inode share one inotify watch.
+ */
+expect<ifd*> file_tail::watch(const std::string& path, bool from_start)
+{
+    if(_fd < 0) return rem::push_error(HERE) << " file_tail not attached to a listener";
+    for(auto& t : _files)
+        if(t->path == path) return rem::push_error(HERE) << " " << path << " already watched";
+
+    auto t = std::make_unique<file>();
+    t->path = path;
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash ? path.substr(0, slash) : "/");
+    t->name = slash == std::string::npos ? path : path.substr(slash + 1);
+    t->f.options = ifd::O_READ;
+    t->f.state.active = true;
+
+    t->dir_wd = ::inotify_add_watch(_fd, dir.c_str(), dir_events);
+    if(t->dir_wd < 0) return rem::push_error(HERE) << " inotify_add_watch(" << dir << "): " << std::strerror(errno);
+    // Not there yet: picked up at its IN_CREATE.
+    if(::access(path.c_str(), F_OK) == 0)
+    {
+        auto R = open_file(*t, from_start);
+        if(!R)
+        {
+            // The directory's watch is ours alone unless another file of that directory shares it.
+            if(!_by_dir.count(t->dir_wd)) (void)::inotify_rm_watch(_fd, t->dir_wd);
+            return R();
+        }
+    }
+    _by_dir.emplace(t->dir_wd, t.get());
+    auto* f = &t->f;
+    _files.push_back(std::move(t));
+    return f;
+}
+
+
+/*!
+ * \brief file_tail::unwatch stops following \a path and closes it. Not from within a read_signal of this file_tail.
+ */
+expect<> file_tail::unwatch(const std::string& path)
+{
+    for(auto it = _files.begin(); it != _files.end(); ++it)
+    {
+        auto& t = **it;
+        if(t.path != path) continue;
+        close_file(t);
+        auto range = _by_dir.equal_range(t.dir_wd);
+        for(auto d = range.first; d != range.second; ++d)
+            if(d->second == &t) { _by_dir.erase(d); break; }
+        if(!_by_dir.count(t.dir_wd)) (void)::inotify_rm_watch(_fd, t.dir_wd);
+        _files.erase(it);
+        return rem::ok;
+    }
+    return rem::push_error(HERE) << " " << path << " not watched";
+}
+
+
+expect<> file_tail::open_file(file& t, bool from_start)
+{
+    int fd = ::open(t.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return rem::push_error(HERE) << " open(" << t.path << "): " << std::strerror(errno);
+    int wd = ::inotify_add_watch(_fd, t.path.c_str(), file_events);
+    if(wd < 0)
+    {
+        ::close(fd);
+        return rem::push_error(HERE) << " inotify_add_watch(" << t.path << "): " << std::strerror(errno);
+    }
+    t.offset = from_start ? 0 : ::lseek(fd, 0, SEEK_END);
+    t.f.fd = fd;
+    t.wd = wd;
+    _by_wd[wd] = &t;
+    return rem::ok;
+}
+
+
+void file_tail::close_file(file& t)
+{
+    if(t.wd >= 0)
+    {
+        _by_wd.erase(t.wd);
+        (void)::inotify_rm_watch(_fd, t.wd);
+        t.wd = -1;
+    }
+    if(t.f.fd >= 0) ::close(t.f.fd);
+    t.f.fd = -1;
+}
+
+
+/*!
+ * \brief file_tail::pump delivers the bytes appended to the file since its offset, chunk_size at a time, until caught up
+ * or the handler stops reading.
+ */
+void file_tail::pump(file& t)
+{
+    auto& f = t.f;
+    while(f.fd >= 0)
+    {
+        struct stat st;
+        if(::fstat(f.fd, &st) < 0) return;
+        if(st.st_size < t.offset)
+        {
+            // Truncated in place: start over.
+            t.offset = ::lseek(f.fd, 0, SEEK_SET);
+            (void)_rotated_signal(f);
+        }
+        auto avail = static_cast<std::size_t>(st.st_size - t.offset);
+        if(!avail) return;
+        f.pksize = std::min(avail, chunk_size);
+        if(f.options & ifd::I_AUTOFILL) (void)f.fill();
+        (void)f.read_signal()(f);
+        auto pos = ::lseek(f.fd, 0, SEEK_CUR);
+        if(pos <= t.offset) return; // nothing taken: the rest goes with the next change.
+        t.offset = pos;
+    }
+}
+
+
+/*!
+ * \brief file_tail::events the read_signal of the inotify descriptor.
+ */
+expect<> file_tail::events(ifd& f)
+{
+    alignas(inotify_event) char buf[16 * 1024];
+    ssize_t n;
+    while((n = ::read(f.fd, buf, sizeof(buf))) > 0)
+    {
+        for(char* p = buf; p < buf + n; )
+        {
+            auto* e = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + e->len;
+
+            if(e->mask & IN_Q_OVERFLOW)
+            {
+                // Events lost: catch up on every file, reopen the replaced ones.
+                for(auto& t : _files)
+                {
+                    struct stat now, cur;
+                    if(::stat(t->path.c_str(), &now) < 0) { pump(*t); continue; }
+                    if(t->f.fd < 0 || ::fstat(t->f.fd, &cur) < 0 || cur.st_ino != now.st_ino || cur.st_dev != now.st_dev)
+                    {
+                        pump(*t);
+                        close_file(*t);
+                        if(open_file(*t, true)) (void)_rotated_signal(t->f);
+                    }
+                    pump(*t);
+                }
+                continue;
+            }
+
+            if(auto it = _by_wd.find(e->wd); it != _by_wd.end())
+            {
+                auto& t = *it->second;
+                if(e->mask & (IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF)) pump(t);
+                // Moved or deleted: the fd stays open - the writer may still append - until the new file shows up.
+                if(e->mask & IN_IGNORED)
+                {
+                    _by_wd.erase(it);
+                    t.wd = -1;
+                }
+                continue;
+            }
+
+            if(!(e->mask & (IN_CREATE | IN_MOVED_TO)) || !e->len) continue;
+            auto range = _by_dir.equal_range(e->wd);
+            for(auto d = range.first; d != range.second; ++d)
+            {
+                auto& t = *d->second;
+                if(t.name != e->name) continue;
+                // Rotation: read out the old file, then follow the new one from its start.
+                pump(t);
+                close_file(t);
+                if(!open_file(t, true)) continue;
+                (void)_rotated_signal(t.f);
+                pump(t);
+            }
+        }
+    }
+    return rem::ok;
+}
+
+}
@@ -19,60 +19,97 @@ using namespace book;
 namespace io
 {
 
+static_assert(sizeof(ifd) == 64, "ifd: the hot record must stay one cache line");
 
 
-ifd::ifd():
-    fd(0), options(0), pksize(0), wsize(0), wpos(0), internal_buffer(0)
-{
-
-}
+ifd::ifd() = default;
 
 ifd::ifd(int fd_, uint32_t opt_):
-    fd(fd_), options(opt_), pksize(0), wsize(0), wpos(0), internal_buffer(0)
+    fd(fd_), options(opt_)
 {
 
 }
 
 ifd::~ifd()
 {
-    read_signal.disconnect_all();
-    write_signal.disconnect_all();
-    idle_signal.disconnect_all();
-
     if(options & O_XBUF) return;
     delete [] internal_buffer;
 }
 
+/*!
+ * \brief ifd::toread queries the number of bytes pending in the fd.
+ *
+ * With a non-zero budget, pksize is clamped to it and state.more tells that the fd holds more: the listener then carries
+ * the descriptor over to its next iteration instead of letting one busy descriptor starve the others.
+ * Memory descriptors (O_MEM) already hold their pksize bytes: the poller clamps its deliveries to the budget itself.
+ * \return pksize
+ */
 std::size_t ifd::toread()
 {
-    ioctl(fd,FIONREAD,&pksize);
+    if(options & O_MEM)
+    {
+        state.more = false;
+        return pksize;
+    }
+    int n = 0;
+    if(ioctl(fd,FIONREAD,&n) < 0) n = 0;
+    pksize = static_cast<std::size_t>(n);
+    state.more = budget && pksize > budget;
+    if(state.more) pksize = budget;
     return pksize;
 }
 
-ifd::ifd(ifd &&f) noexcept
+ifd::ifd(ifd &&f) noexcept:
+    fd(f.fd), options(f.options), state(f.state), prio(f.prio), flow(f.flow), max_pksize(f.max_pksize), pksize(f.pksize),
+    internal_buffer(f.internal_buffer), budget(f.budget), wsize(f.wsize), wpos(f.wpos), _handlers(std::move(f._handlers))
 {
-    internal_buffer = std::move(f.internal_buffer);
-    options = std::move(f.options);
-    state = std::move(f.state);
-    fd = std::move(f.fd);
-    read_signal = std::move(f.read_signal);
-    write_signal = std::move(f.write_signal);
-    idle_signal = std::move(f.idle_signal);
-
+    f.internal_buffer = nullptr;
+    f.fd = -1;
 }
 
 
 ifd &ifd::operator=(ifd && f) noexcept {
-    internal_buffer = std::move(f.internal_buffer);
-    options = std::move(f.options);
-    state = std::move(f.state);
-    fd = std::move(f.fd);
-    read_signal = std::move(f.read_signal);
-    write_signal = std::move(f.write_signal);
-    idle_signal = std::move(f.idle_signal);
+    if(this == &f) return *this;
+    if(!(options & O_XBUF)) delete [] internal_buffer;
+    fd = f.fd;
+    options = f.options;
+    state = f.state;
+    prio = f.prio;
+    flow = f.flow;
+    max_pksize = f.max_pksize;
+    pksize = f.pksize;
+    internal_buffer = f.internal_buffer;
+    budget = f.budget;
+    wsize = f.wsize;
+    wpos = f.wpos;
+    _handlers = std::move(f._handlers);
+    f.internal_buffer = nullptr;
+    f.fd = -1;
     return *this;
 }
 
+
+/*!
+ * \brief ifd::signals gives the handlers block of this ifd, creating it on first use.
+ */
+ifd::handlers &ifd::signals()
+{
+    if(!_handlers) _handlers = std::make_shared<handlers>();
+    return *_handlers;
+}
+
+
+/*!
+ * \brief ifd::share_handlers makes this ifd use the same handlers block as \a other.
+ *
+ * Typical use is a server socket handing its connections the same read/write/zero handlers: 100k connections then hold one
+ * handlers block instead of 100k of them.
+ */
+void ifd::share_handlers(const ifd &other)
+{
+    _handlers = other._handlers;
+}
+
 /*!
  * @brief [en]: defines the next window-size of datablock to receive
        [frang]: Definir la window-size du prochain bloc de donnees a recevoir
@@ -96,12 +133,17 @@ expect<std::size_t> ifd::set_window_size(uint32_t sz)
 
 expect<> ifd::data_in()
 {
+    if(options & O_MSG)
+    {
+        if(!(options & O_MEM)) pksize = 0;
+        return read_signal()(*this);
+    }
     (void)toread();
     if (pksize <=0) {
         // Any value under 1 mean there is error or hangup on file descriptor held by this ifd. So it is systematic shutdown using
         // zero_signal notify.
         rem::push_status() << " shutdown signal on  file descriptor #" << fd << " : ";
-        return zero_signal(*this);
+        return zero_signal()(*this);
     }
     if(pksize > max_pksize )
     {
@@ -111,41 +153,62 @@ expect<> ifd::data_in()
         return rem::overflow;
     }
 
-    if(options & I_AUTOFILL)
+    if(options & (I_AUTOFILL | O_MEM))
     {
-        if(!internal_buffer) internal_buffer = new uint8_t[4 * 1024]; // < Arbitrary buffer ....
-        std::memset(internal_buffer, 0, 4 * 1024);
-        (void) ::read(fd, internal_buffer, pksize);
-        return read_signal(*this);
+        (void) fill();
+        return read_signal()(*this);
     }
     //log_debugfn << m_pksize << " bytes to read:" << log_end;
-    uint8_t*  tbuf= new uint8_t[pksize+5];
     if (options & (O_WINDOWED)) {
-        rem::push_debug(HERE) << " this ifd has (WINDOWED) options :" << rem::endl << "     size of window:" << wsize;
-        uint32_t waitingsz = wsize-wpos;
-        uint32_t rsz;
-        if (pksize > waitingsz ) waitingsz = wsize-pksize;
-        rsz = read(fd, tbuf, pksize); // We read ALL waiting bytes, overflow will be discarded!
-        if ( rsz > waitingsz) rsz -= rsz-wsize;
-        memcpy(internal_buffer + wpos, tbuf, rsz); // overflow discarded here. ( pourrais invalider le datablock dans le protocol... tant-pis!)
-        wpos += rsz;
-        if (wpos >= wsize)
-        {
-            // signal to delegate that the window datablock is filled and ready!
-            auto R = window_complete_signal(*this);
-            if(!R) return R();
-            return static_cast<std::size_t>(*R);
-        }
-        // else return remaining bytes to wait for
-        return wsize-wpos;
+        if(!window_in())
+            return wsize-wpos; // remaining bytes to wait for
+        // signal to delegate that the window datablock is filled and ready!
+        auto R = window_complete_signal()(*this);
+        if(!R) return R();
+        return static_cast<std::size_t>(*R);
     }
     // signal to delegate that data is ready to be pulled from the file descriptor.
     //log_debug() << " passing packet receiving to read to the delegate..." << log_end;
-    auto R = read_signal(*this);
+    auto R = read_signal()(*this);
     if(!R) return R();
     return 0;
 }
 
+/*!
+ * \brief ifd::window_in reads the pending pksize bytes into the window (O_WINDOWED) - what goes past wsize is discarded.
+ * \return true when the window is complete.
+ */
+bool ifd::window_in()
+{
+    std::unique_ptr<uint8_t[]> tbuf(new uint8_t[pksize+5]);
+    rem::push_debug(HERE) << " this ifd has (WINDOWED) options :" << rem::endl << "     size of window:" << wsize;
+    uint32_t waitingsz = wsize-wpos;
+    uint32_t rsz;
+    if (pksize > waitingsz ) waitingsz = wsize-pksize;
+    rsz = read(fd, tbuf.get(), pksize); // We read ALL waiting bytes, overflow will be discarded!
+    if ( rsz > waitingsz) rsz -= rsz-wsize;
+    memcpy(internal_buffer + wpos, tbuf.get(), rsz); // overflow discarded here. ( pourrais invalider le datablock dans le protocol... tant-pis!)
+    wpos += rsz;
+    return wpos >= wsize;
+}
+
+
+/*!
+ * \brief ifd::fill reads the pending pksize bytes (see toread()) into the internal buffer - the I_AUTOFILL step.
+ * \return number of bytes read; pksize is updated to that number.
+ */
+std::size_t ifd::fill()
+{
+    if(options & O_MEM) return pksize; // already there.
+    if(!internal_buffer) internal_buffer = new uint8_t[autofill_size]; // < Arbitrary buffer ....
+    std::memset(internal_buffer, 0, autofill_size);
+    if(pksize > autofill_size) pksize = autofill_size; // the rest stays in the fd for the next event.
+    auto n = ::read(fd, internal_buffer, pksize);
+    pksize = n > 0 ? static_cast<std::size_t>(n) : 0;
+    return pksize;
+}
+
+
 uint32_t ifd::set_options(u_int32_t opt)
 {
     options = opt;
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/ifd_table.h"
+#include "iolistener/topology.h"
+#include <new>
+
+namespace io
+{
+
+
+ifd_table::~ifd_table()
+{
+    clear();
+}
+
+
+/*!
+ * \brief ifd_table::add takes a record from the free list - or a new block - and binds it to \a fd_.
+ * \return address of the record, stable until release(); nullptr if fd_ is invalid or already in the table.
+ */
+ifd *ifd_table::add(int fd_, uint32_t opt_)
+{
+    if(fd_ < 0) return nullptr;
+    if(query(fd_)) return nullptr;
+
+    if(_free.empty())
+    {
+        // Placed before the records are constructed: the first touch is on the node.
+        void* raw = ::operator new(sizeof(block), std::align_val_t{alignof(block)});
+        if(_node >= 0) (void)topology::bind(raw, sizeof(block), _node, false);
+        _blocks.emplace_back(new(raw) block);
+        auto* b = _blocks.back()->r;
+        _free.reserve(_free.size() + block_size);
+        // Push in reverse so that the records are handed out in address order.
+        for(std::size_t x = block_size; x > 0; x--)
+            _free.push_back(b + x - 1);
+    }
+
+    ifd* f = _free.back();
+    _free.pop_back();
+    *f = ifd(fd_, opt_);
+
+    if(static_cast<std::size_t>(fd_) >= _index.size())
+        _index.resize(static_cast<std::size_t>(fd_) + 1, nullptr);
+    _index[fd_] = f;
+    ++_count;
+    return f;
+}
+
+
+ifd *ifd_table::query(int fd_) const
+{
+    if(fd_ < 0 || static_cast<std::size_t>(fd_) >= _index.size()) return nullptr;
+    return _index[fd_];
+}
+
+
+/*!
+ * \brief ifd_table::detach removes the record from the fd index only: query() no longer finds it, its fd number can
+ * be added again, but the record stays untouched until release().
+ */
+void ifd_table::detach(ifd *f)
+{
+    if(!f || f->fd < 0) return;
+    if(static_cast<std::size_t>(f->fd) < _index.size() && _index[f->fd] == f)
+        _index[f->fd] = nullptr;
+}
+
+
+/*!
+ * \brief ifd_table::release resets the record (buffer and handlers released) and returns it to the free list.
+ */
+void ifd_table::release(ifd *f)
+{
+    if(!f || f->fd < 0) return;
+    detach(f);
+    *f = ifd();
+    _free.push_back(f);
+    --_count;
+}
+
+
+void ifd_table::clear()
+{
+    _index.clear();
+    _free.clear();
+    _blocks.clear();
+    _count = 0;
+}
+
+
+/*!
+ * \brief ifd_table::memory_usage bytes held by the table itself - records, free list and fd index.
+ * \note Does not include the internal buffers nor the (possibly shared) handlers blocks.
+ */
+std::size_t ifd_table::memory_usage() const
+{
+    return _blocks.size() * sizeof(block)
+         + _blocks.capacity() * sizeof(std::unique_ptr<block>)
+         + _free.capacity() * sizeof(ifd*)
+         + _index.capacity() * sizeof(ifd*);
+}
+
+
+/*!
+ * \brief ifd_table::set_node places the blocks on NUMA \a node - those to come, and the existing ones, migrated.
+ * \note The fd index and the free list are plain vectors: they follow the memory policy of the thread that grows them.
+ */
+void ifd_table::set_node(int node)
+{
+    _node = node;
+    if(node < 0) return;
+    for(auto& b : _blocks) (void)topology::bind(b.get(), sizeof(block), node, true);
+}
+
+}
@@ -13,8 +13,18 @@
 
 #include "iolistener/listener.h"
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #include <errno.h>
 #include <error.h>
+#include <pthread.h>
+#include <sched.h>
+#include <chrono>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // linux 5.11 - not yet in every libc's headers.
+#endif
 
 using namespace book;
 
@@ -40,66 +50,47 @@ listener::~listener()
     _ifds.clear();
 }
 
-expect<> listener::run()
+namespace
 {
+/*!
+ * \brief the ifd signals of run() - see listener::loop().
+ */
+struct signal_dispatch
+{
+    listener& l;
 
-    rem::push_debug(HERE) << " _epoll_event.events:" << color::Yellow << "%08b" << _epoll_event.events << color::Reset << ":";
-    if(!_epoll_event.events)
-        return rem::push_info(HERE) << "events poll empty - dismissing this listener";
-
-    auto num = _ifds.size();
-    epoll_event events[_maxifd];
-    int ev_count=0;
-
-    ifd::iterator i;
+    static rem::code code(expect<> R)
+    {
+        if(!R) return rem::rejected;
+        return *R;
+    }
+    void idle() { l.idle_signal()(); }
+    rem::code read(ifd& f) { return code(f.read_signal()(f)); }
+    rem::code write(ifd& f) { return code(f.write_signal()(f)); }
+    rem::code window(ifd& f) { return code(f.window_complete_signal()(f)); }
+    bool urgent(ifd& f, rem::code& c)
+    {
+        if(f.urgent_signal().empty()) return false;
+        c = code(f.urgent_signal()(f));
+        return true;
+    }
+    void close(ifd& f) { l.err_hup(f); }
+    void zero(ifd& f)
+    {
+        rem::push_status() << " shutdown signal on  file descriptor #" << f.fd << " : ";
+        (void)f.zero_signal()(f);
+    }
+};
+}
 
-    do{
-        //rem::push_debug(HERE) << " epoll_wait:";
-        ev_count = epoll_wait(_epollfd,events,num,msec);
-        //rem::push_debug(HERE) << " epoll_wait:[" << color::Yellow << ev_count << color::Reset << "]:";
 
-        if(!ev_count)
-        {
-            //rem::push_debug(HERE) << "Invoke _idle_signal(): " << color::Yellow << (_idle_signal.empty() ? "no hook..." : "");
-            _idle_signal();
-            continue;
-        }
+expect<> listener::run()
+{
 
-        for(int e=0; e < ev_count; e++)
-        {
-            uint32_t ev = events[e].events;
-            int fd = events[e].data.fd;
-            //rem::push_info(HERE) << rem::stamp <<  " event on fd " << color::Red4 << fd << color::Reset;
-            auto i = query_fd(fd);
-            if(i==_ifds.end())
-            {
-                rem::push_error(HERE) << " event triggered on descriptor which is not in this listener...";
-                break;
-            }
-            expect<> R;
-            if(ev & (EPOLLERR | EPOLLHUP))
-            {
-                err_hup(*i);
-                continue;
-            }
-            if(ev & EPOLLOUT) {
-                R = epoll_data_out(*i);
-                ///@todo handle R;
-                continue;
-            }
-            if (ev & EPOLLIN) {
-                R = epoll_data_in(*i);
-                if(!R)
-                {
-                    rem::push_status(HERE) << " epoll_data_in(" << color::Yellow << i->fd << color::Reset << ") breaks.";
-                    continue;
-                }
-                if(*R == rem::end) shutdown();
-                ///@todo handle R;
-                continue;
-            }
-        }// epoll events iteration
-    }while(!_terminate);
+    rem::push_debug(HERE) << " _epoll_event.events:" << color::Yellow << "%08b" << _epoll_event.events << color::Reset << ":";
+    signal_dispatch d{*this};
+    auto R = loop(d);
+    if(!R) return R;
     rem::push_info(HERE) << color::PaleVioletRed1 << " exited from the main loop of the listener: ";
     return rem::ok;
 }
@@ -111,83 +102,300 @@ expect<> listener::add_ifd(int fd_, uint32_t opt_)
 {
     rem::push_debug(HERE) << " fd = " << color::Yellow << fd_;
     auto i = query_fd(fd_);
-    if(i != _ifds.end())
+    if(i)
         return rem::push_error(HERE) << " file descriptor" << fd_ << " already in the epoll set ";
 
-    _ifds.emplace_back(fd_, opt_);
+    auto* f = _ifds.add(fd_, opt_);
+    if(!f)
+        return rem::push_error(HERE) << " invalid file descriptor " << fd_;
 
-    epoll_event ev;
-    ev.events = _epoll_event.events;
-    auto &fd = _ifds.back();
+    auto &fd = *f;
     fd.state.active = true;
-    ev.data.fd = fd.fd;
-    epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd.fd, &ev );
+    fd.budget = _budget;
+    fd.flow.armed_in = (_epoll_event.events & EPOLLIN) != 0;
+    if(auto R = _poller->add(fd, _epoll_event.events); !R)
+    {
+        _ifds.release(f);
+        return R;
+    }
+    if((_busy.so_busy_poll || _busy.prefer_busy_poll) && !_poller->simulated()) set_busy_poll_sockopt(fd.fd);
     rem::push_info(HERE) << " added ifd[fd=" << fd.fd << "]";
     return rem::ok;
 }
 
+/*!
+ * \brief listener::remove_ifd takes the descriptor out of the epoll set. The file descriptor itself is left open.
+ *
+ * The record is detached at once - query_fd() no longer finds it and the same fd number can be added again - but it is
+ * only released at the end of the current loop iteration (see reap()), so the ifd& held by the handlers of this batch,
+ * and the pending events that point to it, stay valid.
+ */
 expect<> listener::remove_ifd(int fd_)
 {
     auto i = query_fd(fd_);
-    if(i==_ifds.end())
+    if(!i)
         return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
 
 
     rem::push_info() << " removing ifd from the epoll set" << rem::endl << " fd:" << i->fd;
 
-    auto fdi = i->fd;
-    epoll_event ev;// prend pas de chance pour EPOLL_CTL_DEL - selon la doc, ev doit etre non-null dans la version 2.6.9- du kernel....
-    // completement ignor&eacute; dans 2.6.9+
-    ev.events = _epoll_event.events;
-    ev.data.fd = i->fd;
-    epoll_ctl(_epollfd, EPOLL_CTL_DEL, i->fd, &ev );
-    _ifds.erase(i);
-    rem::push_info(HERE) << " removed fd[" << fdi << "] from the epoll set, and destroyed.";
+    (void)_poller->remove(*i);
+    discard(i);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief listener::close_ifd removes the descriptor and closes its file descriptor at the end of the loop iteration.
+ *
+ * Taken out of the epoll set first, as remove_ifd(): the close() alone does not drop the registration while the open file
+ * is still referenced - a dup, a child process that inherited it, or fds 0-2 which are never closed - and its events
+ * would then carry a released record.
+ */
+expect<> listener::close_ifd(int fd_)
+{
+    auto i = query_fd(fd_);
+    if(!i)
+        return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
+    (void)_poller->remove(*i);
+    i->state.closing = true;
+    discard(i);
     return rem::ok;
 }
 
+
+void listener::discard(ifd *i)
+{
+    i->state.destroy = true;
+    i->state.active = false;
+    if(static_cast<std::size_t>(i->fd) < _marks.size()) _marks[i->fd] = {};
+    if(i->flow.flush) std::erase(_flush, i);
+    _ifds.detach(i);
+    _zombies.push_back(i);
+    if(!_dispatching) reap();
+}
+
+
+/*!
+ * \brief listener::reap releases the records removed during the iteration. Called at the end of each loop iteration.
+ */
+void listener::reap()
+{
+    _dispatching = false;
+    for(auto* i : _zombies)
+    {
+        if(i->state.carry) std::erase(_carry, i);
+        if(i->state.closing)
+            _poller->close_fd(i->fd);
+        _ifds.release(i);
+    }
+    _zombies.clear();
+}
+
+/*!
+ * \brief listener::carry queues \a f for a continuation dispatch on the next iteration - read_signal (or on_read) with
+ * pksize = 0 - whether or not a new event comes in for it.
+ *
+ * A handler that stops on its own budget with work left calls it to give the other descriptors their turn before resuming;
+ * the listener calls it itself when toread() was clamped to ifd::budget. The wait does not block while descriptors are carried.
+ */
+void listener::carry(ifd &f)
+{
+    if(f.state.carry || f.state.destroy) return;
+    f.state.carry = true;
+    _carry.push_back(&f);
+}
+
+
+/*!
+ * \brief listener::collect sorts the batch into the ready lists by ifd::priority - EPOLLPRI events go to the control class -
+ * then appends the carried descriptors that have no event of their own in this batch.
+ */
+void listener::collect(const epoll_event *events, int n)
+{
+    for(auto& q : _ready) q.clear();
+    for(int e = 0; e < n; e++)
+    {
+        auto* i = static_cast<ifd*>(events[e].data.ptr);
+        if(i->state.destroy) continue;
+        auto ev = events[e].events;
+        auto c = (ev & EPOLLPRI) ? ifd::priority::control : i->prio;
+        i->state.queued = true;
+        _ready[static_cast<std::size_t>(c)].push_back({i, ev});
+    }
+    for(auto* i : _carry)
+    {
+        i->state.carry = false;
+        if(i->state.queued || i->state.destroy) continue;
+        i->state.queued = true;
+        _ready[static_cast<std::size_t>(i->prio)].push_back({i, 0});
+    }
+    _carry.clear();
+}
+
+
+/*!
+ * \brief listener::pause_ifd stops reading the descriptor: EPOLLIN is taken out of its epoll mask (EPOLL_CTL_MOD), the
+ * hangups and errors are still reported. The descriptor stays in the listener; resume_ifd() re-arms it.
+ */
 expect<> listener::pause_ifd(int fd_)
 {
     auto i = query_fd(fd_);
-    if(i==_ifds.end())
+    if(!i)
+        return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
+    i->flow.paused = true;
+    rearm(*i);
+    return rem::ok;
+}
+
+
+expect<> listener::resume_ifd(int fd_)
+{
+    auto i = query_fd(fd_);
+    if(!i)
+        return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
+    i->flow.paused = false;
+    rearm(*i);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief listener::want_write arms (or disarms) EPOLLOUT: write_signal / on_write is called while the fd can take more
+ * bytes. Arm it when there is something to write and the fd is full, disarm it once the output is flushed.
+ */
+expect<> listener::want_write(int fd_, bool on)
+{
+    auto i = query_fd(fd_);
+    if(!i)
         return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
-    epoll_event ev;// prend pas de chance pour EPOLL_CTL_DEL - selon la doc, ev doit etre non-null dans la version 2.6.9- du kernel....
-    // completement ignor&eacute; dans 2.6.9+
-    ev.events = _epoll_event.events;
-    ev.data.fd = i->fd;
-    epoll_ctl(_epollfd, EPOLL_CTL_DEL, i->fd, &ev );
-    rem::push_info(HERE) << " fd[" << fd_ <<"] is paused";
+    i->flow.want_out = on;
+    rearm(*i);
     return rem::ok;
 }
 
+
+/*!
+ * \brief listener::set_watermarks read backpressure of the descriptor.
+ *
+ * The handlers account the bytes they hold for the descriptor - read but not yet consumed downstream - with buffered().
+ * Reaching \a high takes EPOLLIN out of the epoll mask; draining down to \a low puts it back. The data in the meantime
+ * stays in the kernel: the peer is slowed down by its own flow control instead of growing our buffers.
+ * \a high = 0 disables it.
+ */
+expect<> listener::set_watermarks(int fd_, std::size_t high, std::size_t low)
+{
+    auto i = query_fd(fd_);
+    if(!i)
+        return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
+    if(static_cast<std::size_t>(fd_) >= _marks.size()) _marks.resize(fd_ + 1);
+    auto& m = _marks[fd_];
+    m.high = high;
+    m.low = std::min(low, high);
+    i->flow.watch = high != 0;
+    (void)buffered(fd_, 0);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief listener::buffered adds \a delta (negative: drained) to the buffered bytes of the descriptor and applies its
+ * watermarks - no system call unless the descriptor crosses one.
+ * \return the buffered bytes now.
+ */
+expect<std::size_t> listener::buffered(int fd_, std::ptrdiff_t delta)
+{
+    auto i = query_fd(fd_);
+    if(!i)
+        return rem::push_error(HERE) << " fd " << fd_ << " not in this epoll set";
+    if(static_cast<std::size_t>(fd_) >= _marks.size()) _marks.resize(fd_ + 1);
+    auto& m = _marks[fd_];
+    if(delta < 0 && static_cast<std::size_t>(-delta) > m.buffered)
+        m.buffered = 0;
+    else
+        m.buffered += delta;
+
+    bool throttle = i->flow.watch && (i->flow.throttled ? m.buffered > m.low : m.buffered >= m.high);
+    if(throttle != static_cast<bool>(i->flow.throttled))
+    {
+        i->flow.throttled = throttle;
+        rearm(*i);
+    }
+    return m.buffered;
+}
+
+
+/*!
+ * \brief listener::flush queues \a f for a write_signal (or on_write) call at the end of the current iteration, after all
+ * the ready descriptors were dispatched - once, however many times it is queued.
+ *
+ * The output produced by the handlers of a batch is thus written with one syscall per descriptor, without EPOLLOUT and its
+ * EPOLL_CTL_MODs while the fd can take it (see want_write() for when it cannot). Queued outside of the loop, the flush is
+ * done by the next iteration: the wait does not block while descriptors are queued. Listener thread only.
+ */
+void listener::flush(ifd &f)
+{
+    if(f.flow.flush || f.state.destroy) return;
+    f.flow.flush = true;
+    _flush.push_back(&f);
+}
+
+
+/*!
+ * \brief listener::rearm applies the flow flags of the descriptor to its epoll mask - EPOLL_CTL_MOD only if it changes.
+ */
+void listener::rearm(ifd &i)
+{
+    bool in  = !(i.flow.paused || i.flow.throttled);
+    bool out = i.flow.want_out;
+    if(in == static_cast<bool>(i.flow.armed_in) && out == static_cast<bool>(i.flow.armed_out)) return;
+    uint32_t events = _epoll_event.events & ~EPOLLIN;
+    if(in)  events |= EPOLLIN;
+    if(out) events |= EPOLLOUT;
+    if(!_poller->modify(i, events)) return;
+    i.flow.armed_in = in;
+    i.flow.armed_out = out;
+}
+
+
 expect<> listener::init()
 {
     rem::push_debug(HERE) << ":";
     _terminate = false;
-    _epollfd = epoll_create(_maxifd);
+    if(auto R = _poller->init(); !R) return R;
     _epoll_event.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
     return rem::ok;
 }
 
 
+/*!
+ * \brief listener::set_poller replaces the readiness backend - before any descriptor is added: the registered ones are
+ * not carried over. Call init() afterwards.
+ */
+expect<> listener::set_poller(std::unique_ptr<poller> p)
+{
+    if(count())
+        return rem::push_error(HERE) << " cannot replace the poller of a listener holding " << count() << " descriptors";
+    if(!p)
+        return rem::push_error(HERE) << " null poller";
+    if(_poller) _poller->close();
+    _poller = std::move(p);
+    return rem::ok;
+}
+
+
 expect<> listener::shutdown()
 {
     _terminate = true;
     //close/shutdown all ifd's
-    for(auto &f : _ifds)
-    {
-        if(f.fd > 2) // NEVER-EVER shutdown STDIN, STDOUT, or STDERR !!! LOL
-            ::shutdown(f.fd, SHUT_RDWR);
-    }
-    close(_epollfd);
+    _ifds.for_each([this](ifd& f){ _poller->shutdown_fd(f.fd); });
+    _poller->close();
     return rem::accepted;
 }
 
-ifd::iterator listener::query_fd(int fd_)
+ifd* listener::query_fd(int fd_)
 {
-    for(auto it = _ifds.begin(); it != _ifds.end(); it++)
-        if(it->fd == fd_) return it;
-    return _ifds.end();
+    return _ifds.query(fd_);
 }
 
 
@@ -215,11 +423,7 @@ expect<> listener::epoll_data_in(ifd &i)
         }
     }
 
-    // re-enable listening:
-    epoll_event e;
-    e.data.fd = i.fd;
-    e.events = (i.options & ifd::O_READ) ? EPOLLIN: 0 | (i.options & ifd::O_WRITE) ? EPOLLOUT: 0 |EPOLLERR | EPOLLHUP;
-    epoll_ctl(_epollfd, EPOLL_CTL_MOD, i.fd,&e);
+    // Level-triggered, the mask is unchanged: nothing to re-arm (see rearm()).
     return E;
 }
 
@@ -233,12 +437,8 @@ expect<> listener::epoll_data_out(ifd &i)
     expect<> E;
     if(i.state.active){
         //rem::push_debug(HERE) << " writting on fd " << i.fd;
-        E = i.write_signal(i);
+        E = i.write_signal()(i);
     }
-    epoll_event e;
-    e.data.fd = i.fd;
-    e.events = (i.options & ifd::O_READ) ? EPOLLIN: 0 | (i.options & ifd::O_WRITE) ? EPOLLOUT: 0 |EPOLLERR | EPOLLHUP;
-    epoll_ctl(_epollfd, EPOLL_CTL_MOD, i.fd,&e);
     return E;
 }
 
@@ -246,9 +446,184 @@ void listener::err_hup(ifd &f)
 {
     rem::push_error(HERE) << color::White << " fd[" << color::Yellow << f.fd << color::White << "] error or hangup." << rem::endl
         << " removing file descriptor";
-    remove_ifd(f.fd);
+    _hup_signal(f);
+    // The end of stream of the descriptor, as for a zero-length read.
+    if(!f.state.destroy && f.has_handlers()) (void)f.zero_signal()(f);
+    if(!f.state.destroy) remove_ifd(f.fd);
+}
+
+
+
+namespace
+{
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+
+/*!
+ * \brief listener::set_busy_poll sets the hybrid busy-poll mode.
+ *
+ * With spin_usec > 0, each wait first polls epoll without blocking for up to spin_usec microseconds, then blocks as usual
+ * for the rest of the timeout. This trades cpu for the wakeup latency of a blocked thread: see stats() for the
+ * spin/sleep split. The socket options are applied to the descriptors already registered and to the next ones.
+ * The cpu pinning takes effect at the next run().
+ */
+expect<> listener::set_busy_poll(const busy_poll &cfg)
+{
+    _busy = cfg;
+    if((_busy.so_busy_poll || _busy.prefer_busy_poll) && !_poller->simulated())
+        _ifds.for_each([this](ifd& f){ if(!f.state.destroy) set_busy_poll_sockopt(f.fd); });
+    return rem::ok;
+}
+
+
+void listener::set_busy_poll_sockopt(int fd)
+{
+    // Not a socket (tty, pipe, eventfd...): ENOTSOCK, nothing to do.
+    if(_busy.so_busy_poll)
+        (void)setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &_busy.so_busy_poll, sizeof(_busy.so_busy_poll));
+    if(_busy.prefer_busy_poll)
+    {
+        int one = 1;
+        (void)setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+    }
+}
+
+
+/*!
+ * \brief listener::set_placement pins the loop thread and places its memory on a NUMA node: the descriptor table blocks
+ * (moved there now), and what the loop thread allocates from run() on - internal buffers, pipeline pools - through its
+ * preferred memory policy. The thread settings take effect at the next run().
+ *
+ * With placement::counters, the loop thread's memory reads served by its node and by a remote one are counted - perf
+ * PERF_COUNT_HW_CACHE_NODE events, when the cpu and the perf_event_paranoid setting allow them - into stats().
+ */
+expect<> listener::set_placement(const placement &p)
+{
+    _place = p;
+    _node = p.node;
+    if(_node < 0 && p.cpu >= 0)
+    {
+        topology t;
+        (void)t.load();
+        _node = t.node_of(p.cpu);
+    }
+    _ifds.set_node(_node);
+    return rem::ok;
+}
+
+
+void listener::pin_thread()
+{
+    int cpu = _place.cpu >= 0 ? _place.cpu : _busy.cpu;
+    if(cpu >= 0) (void)topology::pin(pthread_self(), cpu);
+    if(_node >= 0) (void)topology::prefer_node(_node);
+    if(!_place.counters || _perf[0] >= 0) return;
+
+    for(int x = 0; x < 2; x++)
+    {
+        perf_event_attr a{};
+        a.size = sizeof(a);
+        a.type = PERF_TYPE_HW_CACHE;
+        a.config = PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                 | ((x ? PERF_COUNT_HW_CACHE_RESULT_MISS : PERF_COUNT_HW_CACHE_RESULT_ACCESS) << 16);
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        _perf[x] = static_cast<int>(syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+    if(_perf[0] < 0 || _perf[1] < 0)
+    {
+        rem::push_warning(HERE) << " node memory counters not available: " << std::strerror(errno);
+        for(auto& fd : _perf)
+        {
+            if(fd >= 0) ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+
+/*!
+ * \brief listener::sample_counters updates stats().node_local/node_remote from the loop thread's counters. Listener thread
+ * only - a handler or the idle slot - while run() is running; run() does it when it returns.
+ *
+ * The node events count the reads that reached a node (access) and those of them served by a remote one (miss): the
+ * local ones are the difference.
+ */
+void listener::sample_counters()
+{
+    if(_perf[0] < 0) return;
+    uint64_t v[2] = {0, 0};
+    for(int x = 0; x < 2; x++)
+        if(::read(_perf[x], &v[x], sizeof(v[x])) != sizeof(v[x])) v[x] = 0;
+    _stats.node_local = _perf_base[0] + (v[0] > v[1] ? v[0] - v[1] : 0);
+    _stats.node_remote = _perf_base[1] + v[1];
+}
+
+
+void listener::end_run()
+{
+    sample_counters();
+    for(int x = 0; x < 2; x++)
+    {
+        if(_perf[x] >= 0) ::close(_perf[x]);
+        _perf[x] = -1;
+    }
+    _perf_base[0] = _stats.node_local;
+    _perf_base[1] = _stats.node_remote;
+}
+
+
+void listener::reset_stats()
+{
+    _stats = {};
+    _perf_base[0] = _perf_base[1] = 0;
+    for(int fd : _perf)
+        if(fd >= 0) (void)ioctl(fd, PERF_EVENT_IOC_RESET, 0);
 }
 
 
+/*!
+ * \brief listener::wait the poller wait of the loop: spin phase (busy-poll mode) then blocking phase, accounted in stats().
+ */
+int listener::wait(epoll_event *events)
+{
+    if(!_carry.empty() || !_flush.empty()) // work carried over or output to flush: only pick up what is ready, do not block.
+        return _poller->wait(events, _maxevents, 0);
+
+    auto t0 = now_ns();
+    int n;
+    int timeout = msec;
+    if(_busy.spin_usec && msec)
+    {
+        auto deadline = t0 + _busy.spin_usec * 1000ull;
+        uint64_t t;
+        do{
+            n = _poller->wait(events, _maxevents, 0);
+            t = now_ns();
+            if(n)
+            {
+                _stats.spin_ns += t - t0;
+                if(n > 0) ++_stats.spin_wakeups;
+                return n;
+            }
+        }while(!_terminate && t < deadline);
+        _stats.spin_ns += t - t0;
+        if(msec > 0)
+        {
+            timeout = msec - static_cast<int>((t - t0) / 1000000);
+            if(timeout <= 0) { ++_stats.idle; return 0; }
+        }
+        t0 = t;
+    }
+    n = _poller->wait(events, _maxevents, timeout);
+    _stats.sleep_ns += now_ns() - t0;
+    if(n > 0) ++_stats.sleep_wakeups;
+    else if(!n) ++_stats.idle;
+    return n;
 }
 
+}
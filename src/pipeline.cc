@@ -0,0 +1,402 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/pipeline.h"
+#include <sys/eventfd.h>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+pipeline::pipeline(object* parent, work_fn fn, std::size_t workers, std::size_t ring_size, uint32_t buffer_size):
+    object(parent, "pipeline"), _fn(std::move(fn)), _nworkers(workers), _ring_size(ring_size ? ring_size : 1024),
+    _bufsize(buffer_size ? buffer_size : 16 * 1024)
+{
+}
+
+/*!
+ * \brief pipeline::~pipeline stops the workers and gives back to the listener what attach() and add() registered: the
+ * connections still open are closed, as at their end of stream. Destroy the pipeline before its listener.
+ */
+pipeline::~pipeline()
+{
+    (void)stop();
+    for(std::size_t fd = 0; fd < _conns.size(); fd++)
+    {
+        auto& c = _conns[fd];
+        if(!c.open) continue;
+        drop(c, static_cast<int>(fd));
+        if(_listener->query_fd(static_cast<int>(fd))) (void)_listener->close_ifd(static_cast<int>(fd));
+    }
+    if(_listener && _listener->query_fd(_efd)) (void)_listener->close_ifd(_efd);
+    else if(_efd >= 0) ::close(_efd);
+}
+
+
+/*!
+ * \brief pipeline::attach creates the return eventfd, registers it into \a l and starts the workers.
+ */
+expect<> pipeline::attach(listener& l)
+{
+    if(_listener) return rem::push_error(HERE) << " pipeline already attached";
+    _listener = &l;
+    if(!_nworkers) return rem::ok;
+
+    _efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(_efd < 0) return rem::push_error(HERE) << " eventfd: " << std::strerror(errno);
+    auto R = l.add_ifd(_efd, ifd::O_READ | ifd::O_MSG);
+    if(!R) return R;
+    auto* f = l.query_fd(_efd);
+    f->prio = ifd::priority::control; // the responses go out before more requests are read.
+    f->read_signal().connect(this, &pipeline::doorbell);
+
+    _stop = false;
+    for(std::size_t x = 0; x < _nworkers; x++)
+        _workers.emplace_back(std::make_unique<worker>(_ring_size));
+    for(auto& w : _workers)
+        w->thread = std::thread(&pipeline::work, this, std::ref(*w));
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::add registers the connection \a fd into the listener; its data goes through the pipeline from now on.
+ *
+ * The connection is closed by the pipeline at its end of stream or hangup. With \a high > 0, its reads are paused
+ * while it holds \a high bytes of buffers, until it is back to \a low (see listener::set_watermarks()).
+ */
+expect<> pipeline::add(int fd, std::size_t high, std::size_t low)
+{
+    if(!_listener) return rem::push_error(HERE) << " pipeline not attached to a listener";
+    if(_stop) return rem::push_error(HERE) << " pipeline stopped";
+    auto R = _listener->add_ifd(fd, ifd::O_READ | ifd::O_WRITE);
+    if(!R) return R;
+    auto* f = _listener->query_fd(fd);
+    f->read_signal().connect(this, &pipeline::data_in);
+    f->write_signal().connect(this, &pipeline::data_out);
+    f->zero_signal().connect(this, &pipeline::closed);
+
+    if(static_cast<std::size_t>(fd) >= _conns.size()) _conns.resize(fd + 1);
+    auto& c = _conns[fd];
+    drop(c, -1);
+    ++c.gen;
+    c.inflight = 0;
+    c.worker = -1;
+    c.open = true;
+    if(high) return _listener->set_watermarks(fd, high, low);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::stop stops and joins the workers. Items still in the rings are dropped.
+ *
+ * The pipeline reads no more from then on: each connection is paused at its next read (listener thread) - its data stays
+ * in the kernel - and add() is refused. The connections stay open until the pipeline is destroyed.
+ */
+expect<> pipeline::stop()
+{
+    _stop = true;
+    for(auto& w : _workers)
+    {
+        w->bell.fetch_add(1);
+        w->bell.notify_one();
+    }
+    for(auto& w : _workers)
+        if(w->thread.joinable()) w->thread.join();
+    return rem::ok;
+}
+
+
+uint8_t* pipeline::take()
+{
+    if(_pool.empty())
+    {
+        _buffers.emplace_back(new uint8_t[_bufsize]);
+        return _buffers.back().get();
+    }
+    auto* b = _pool.back();
+    _pool.pop_back();
+    return b;
+}
+
+
+/*!
+ * \brief pipeline::pick the worker of a connection that has nothing in flight: the least loaded one for a new connection;
+ * an idle one if its current worker is behind by more than the rebalance depth; its current one otherwise.
+ */
+int pipeline::pick(int current)
+{
+    int least = 0;
+    for(std::size_t x = 1; x < _workers.size(); x++)
+        if(_workers[x]->inflight < _workers[least]->inflight) least = static_cast<int>(x);
+    if(current < 0) return least;
+    if(_workers[current]->inflight > _rebalance && !_workers[least]->inflight)
+    {
+        ++_stats.migrated;
+        return least;
+    }
+    return current;
+}
+
+
+void pipeline::wake(worker& w)
+{
+    w.bell.fetch_add(1);
+    if(w.sleeping.load()) w.bell.notify_one();
+}
+
+
+/*!
+ * \brief pipeline::submit listener thread: hands \a it to the connection's worker - or runs it inline without workers.
+ */
+void pipeline::submit(conn& c, item& it)
+{
+    ++_stats.submitted;
+    if(_workers.empty())
+    {
+        _fn(it);
+        complete(it);
+        return;
+    }
+    // Nothing in flight: the worker can change without breaking the order of the connection's items.
+    if(!c.inflight) c.worker = pick(c.worker);
+    auto& w = *_workers[c.worker];
+    ++c.inflight;
+    ++w.inflight;
+    (void)_listener->buffered(it.fd, _bufsize);
+    if(!w.backlog.empty() || !w.in.push(it))
+        w.backlog.push_back(it);
+    else
+        wake(w);
+}
+
+
+/*!
+ * \brief pipeline::data_in listener thread: reads the pending bytes into pooled buffers and submits them.
+ */
+expect<> pipeline::data_in(ifd& f)
+{
+    // Stopped: nobody drains the rings any more.
+    if(_stop) return _listener->pause_ifd(f.fd);
+    auto& c = _conns[f.fd];
+    auto left = f.pksize;
+    while(left && !f.flow.throttled)
+    {
+        item it;
+        it.fd = f.fd;
+        it.gen = c.gen;
+        it.capacity = _bufsize;
+        it.data = take();
+        auto n = ::read(f.fd, it.data, std::min<std::size_t>(left, _bufsize));
+        if(n <= 0)
+        {
+            _pool.push_back(it.data);
+            break;
+        }
+        it.size = static_cast<uint32_t>(n);
+        left -= n;
+        submit(c, it);
+    }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::complete listener thread: writes the response back, if the connection is still the same, and
+ * recycles the buffer - or queues it until the connection takes it.
+ */
+void pipeline::complete(item& it)
+{
+    ++_stats.completed;
+    auto& c = _conns[it.fd];
+    if(c.gen != it.gen || !c.open)
+    {
+        ++_stats.dropped;
+        _pool.push_back(it.data);
+        return;
+    }
+    if(c.inflight)
+    {
+        --c.inflight;
+        if(!_workers.empty()) (void)_listener->buffered(it.fd, -static_cast<std::ptrdiff_t>(_bufsize));
+    }
+    if(!it.size)
+    {
+        _pool.push_back(it.data);
+        return;
+    }
+    // Behind others already waiting: in order.
+    bool idle = c.unsent.empty();
+    c.unsent.push_back(it);
+    (void)_listener->buffered(it.fd, _bufsize);
+    if(!idle) return;
+    if(!write_out(c, it.fd)) return;
+    if(!c.unsent.empty())
+    {
+        ++_stats.short_writes;
+        (void)_listener->want_write(it.fd, true);
+    }
+}
+
+
+/*!
+ * \brief pipeline::write_out writes the queued responses of the connection, recycling their buffers, until the socket is
+ * full. A write error closes the connection.
+ * \return false if the connection was closed.
+ */
+bool pipeline::write_out(conn& c, int fd)
+{
+    while(!c.unsent.empty())
+    {
+        auto& it = c.unsent.front();
+        auto n = ::write(fd, it.data + c.sent, it.size - c.sent);
+        if(n < 0)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            ++_stats.write_errors;
+            rem::push_error(HERE) << " write(" << fd << "): " << std::strerror(errno) << " - closing the connection";
+            drop(c, fd);
+            (void)_listener->close_ifd(fd);
+            return false;
+        }
+        c.sent += static_cast<uint32_t>(n);
+        if(c.sent < it.size) continue;
+        _pool.push_back(it.data);
+        c.unsent.pop_front();
+        c.sent = 0;
+        (void)_listener->buffered(fd, -static_cast<std::ptrdiff_t>(_bufsize));
+    }
+    return true;
+}
+
+
+/*!
+ * \brief pipeline::data_out listener thread: the connection takes more - the queued responses go on.
+ */
+expect<> pipeline::data_out(ifd& f)
+{
+    if(static_cast<std::size_t>(f.fd) >= _conns.size()) return rem::ok;
+    auto& c = _conns[f.fd];
+    if(!c.open) return rem::ok;
+    if(write_out(c, f.fd) && c.unsent.empty()) (void)_listener->want_write(f.fd, false);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::drop forgets the connection: its responses in flight will be dropped, the queued ones are.
+ * \a fd < 0: just recycle the queued buffers.
+ */
+void pipeline::drop(conn& c, int fd)
+{
+    for(auto& it : c.unsent) _pool.push_back(it.data);
+    c.unsent.clear();
+    c.sent = 0;
+    if(fd < 0) return;
+    c.open = false;
+    ++c.gen;
+    c.inflight = 0;
+    c.worker = -1;
+}
+
+
+/*!
+ * \brief pipeline::closed listener thread: end of stream or hangup of a connection - closes it; its responses in
+ * flight will be dropped.
+ */
+expect<> pipeline::closed(ifd& f)
+{
+    if(f.fd < 0 || static_cast<std::size_t>(f.fd) >= _conns.size() || !_conns[f.fd].open) return rem::ok;
+    drop(_conns[f.fd], f.fd);
+    if(!f.state.destroy) (void)_listener->close_ifd(f.fd);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::doorbell listener thread: collects the processed items of all the workers and refills their
+ * in rings from the backlogs.
+ */
+expect<> pipeline::doorbell(ifd& f)
+{
+    uint64_t n;
+    (void)::read(f.fd, &n, sizeof(n));
+    // Re-armed before draining: a worker that pushes from now on rings again.
+    _rung.exchange(false);
+    for(auto& w : _workers)
+    {
+        item it;
+        while(w->out.pop(it))
+        {
+            --w->inflight;
+            complete(it);
+        }
+        bool pushed = false;
+        while(!w->backlog.empty() && w->in.push(w->backlog.front()))
+        {
+            w->backlog.pop_front();
+            pushed = true;
+        }
+        if(pushed) wake(*w);
+    }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief pipeline::ring worker side: the eventfd is written once until the listener drains.
+ */
+void pipeline::ring()
+{
+    if(_rung.exchange(true)) return;
+    uint64_t one = 1;
+    (void)::write(_efd, &one, sizeof(one));
+}
+
+
+/*!
+ * \brief pipeline::work the worker thread: pops, processes and returns the items; sleeps on its bell when idle.
+ */
+void pipeline::work(worker& w)
+{
+    item it;
+    while(!_stop.load(std::memory_order_acquire))
+    {
+        auto b = w.bell.load();
+        if(!w.in.pop(it))
+        {
+            // Checked against b: a push after the load changed the bell, the wait returns at once.
+            w.sleeping = true;
+            w.bell.wait(b);
+            w.sleeping = false;
+            continue;
+        }
+        _fn(it);
+        while(!w.out.push(it))
+        {
+            // Return ring full: the listener is behind - make sure it is rung, then wait for room.
+            ring();
+            std::this_thread::yield();
+            if(_stop.load(std::memory_order_acquire)) return;
+        }
+        ring();
+    }
+}
+
+}
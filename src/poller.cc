@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/poller.h"
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+epoll_poller::~epoll_poller()
+{
+    close();
+}
+
+
+/*!
+ * \brief epoll_poller::init creates the epoll set - again after close(): listener::shutdown() closes it.
+ */
+expect<> epoll_poller::init()
+{
+    if(_fd >= 0) return rem::ok;
+    _fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if(_fd < 0) return rem::push_error(HERE) << " epoll_create1: " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+expect<> epoll_poller::add(ifd& f, uint32_t events)
+{
+    epoll_event e;
+    e.events = events;
+    e.data.ptr = &f;
+    if(epoll_ctl(_fd, EPOLL_CTL_ADD, f.fd, &e) < 0)
+        // EPERM: regular file or directory - epoll does not take them (see io::file_engine).
+        return rem::push_error(HERE) << " epoll_ctl(ADD, fd " << f.fd << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+expect<> epoll_poller::modify(ifd& f, uint32_t events)
+{
+    epoll_event e;
+    e.events = events;
+    e.data.ptr = &f;
+    if(epoll_ctl(_fd, EPOLL_CTL_MOD, f.fd, &e) < 0)
+        return rem::push_error(HERE) << " epoll_ctl(MOD, fd " << f.fd << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+expect<> epoll_poller::remove(ifd& f)
+{
+    epoll_event e{};// prend pas de chance pour EPOLL_CTL_DEL - selon la doc, e doit etre non-null dans la version 2.6.9- du kernel....
+    (void)epoll_ctl(_fd, EPOLL_CTL_DEL, f.fd, &e);
+    return rem::ok;
+}
+
+
+int epoll_poller::wait(epoll_event* events, int max, int timeout)
+{
+    return epoll_wait(_fd, events, max, timeout);
+}
+
+
+void epoll_poller::close_fd(int fd)
+{
+    if(fd > 2) ::close(fd); // NEVER-EVER close STDIN, STDOUT, or STDERR !!!
+}
+
+
+void epoll_poller::shutdown_fd(int fd)
+{
+    if(fd > 2) ::shutdown(fd, SHUT_RDWR);
+}
+
+
+void epoll_poller::close()
+{
+    if(_fd >= 0) ::close(_fd);
+    _fd = -1;
+}
+
+}
@@ -0,0 +1,397 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/process.h"
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <cstring>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // linux 5.3
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+extern char** environ;
+
+using namespace book;
+
+namespace io
+{
+
+
+process::process(object* parent, const std::string& ii): object(parent, ii)
+{
+}
+
+process::~process()
+{
+    if(running())
+    {
+        (void)::kill(_pid, SIGKILL);
+        (void)::waitpid(_pid, &_status, 0);
+    }
+    close_all();
+    _exit_signal.disconnect_all();
+}
+
+
+void process::close_all()
+{
+    for(int x = 1; x < 3; x++) unforward(x);
+    for(int& fd : _fds)
+    {
+        if(_listener && _listener->query_fd(fd)) (void)_listener->close_ifd(fd);
+        else if(fd >= 0) ::close(fd);
+        fd = -1;
+    }
+    if(_listener && _listener->query_fd(_pidfd)) (void)_listener->close_ifd(_pidfd);
+    else if(_pidfd >= 0) ::close(_pidfd);
+    _pidfd = -1;
+}
+
+
+/*!
+ * \brief process::abort_spawn the child is running but spawn() fails: kill and reap it, close its descriptors.
+ */
+void process::abort_spawn()
+{
+    (void)::kill(_pid, SIGKILL);
+    (void)::waitpid(_pid, &_status, 0);
+    close_all();
+}
+
+
+/*!
+ * \brief process::spawn starts \a argv[0] (searched in PATH) with pipes on the \a pipes streams; the others are
+ * inherited. \a env empty: the parent's environment.
+ */
+expect<> process::spawn(listener& l, const std::vector<std::string>& argv, const std::vector<std::string>& env, uint8_t pipes)
+{
+    if(running()) return rem::push_error(HERE) << " process " << _pid << " is still running";
+    if(argv.empty()) return rem::push_error(HERE) << " nothing to spawn";
+    close_all();
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    int child[3] = {-1, -1, -1};
+    for(int x = 0; x < 3; x++)
+    {
+        if(!(pipes & (1 << x))) continue;
+        int p[2];
+        if(::pipe2(p, O_CLOEXEC) < 0)
+        {
+            auto err = errno;
+            for(int y = 0; y < x; y++) { if(child[y] >= 0) ::close(child[y]); if(_fds[y] >= 0) ::close(_fds[y]); _fds[y] = -1; }
+            posix_spawn_file_actions_destroy(&fa);
+            return rem::push_error(HERE) << " pipe2: " << std::strerror(err);
+        }
+        // stdin: the child reads p[0]; stdout, stderr: the child writes p[1]. Only the parent's end is non-blocking.
+        _fds[x] = x ? p[0] : p[1];
+        child[x] = x ? p[1] : p[0];
+        (void)::fcntl(_fds[x], F_SETFL, ::fcntl(_fds[x], F_GETFL) | O_NONBLOCK);
+        posix_spawn_file_actions_adddup2(&fa, child[x], x);
+    }
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none, all;
+    sigemptyset(&none);
+    sigfillset(&all);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &all);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    std::vector<char*> av, ev;
+    for(auto const& a : argv) av.push_back(const_cast<char*>(a.c_str()));
+    av.push_back(nullptr);
+    for(auto const& e : env) ev.push_back(const_cast<char*>(e.c_str()));
+    ev.push_back(nullptr);
+
+    int rc = ::posix_spawnp(&_pid, av[0], &fa, &attr, av.data(), env.empty() ? environ : ev.data());
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    for(int c : child) if(c >= 0) ::close(c);
+    if(rc)
+    {
+        _pid = -1;
+        for(int& fd : _fds) { if(fd >= 0) ::close(fd); fd = -1; }
+        return rem::push_error(HERE) << " posix_spawnp(" << argv[0] << "): " << std::strerror(rc);
+    }
+    _status = -1;
+
+    _pidfd = static_cast<int>(::syscall(SYS_pidfd_open, _pid, 0));
+    _listener = &l;
+    if(_pidfd < 0)
+    {
+        auto err = errno;
+        abort_spawn();
+        return rem::push_error(HERE) << " pidfd_open (linux 5.3+): " << std::strerror(err);
+    }
+
+    auto R = l.add_ifd(_pidfd, ifd::O_READ | ifd::O_MSG);
+    if(!R)
+    {
+        abort_spawn();
+        return R;
+    }
+    // An auto-reaped child (SIGCHLD ignored) makes the pidfd hang up, not only readable: both end in exited().
+    l.query_fd(_pidfd)->read_signal().connect(this, &process::exited);
+    l.query_fd(_pidfd)->zero_signal().connect(this, &process::exited);
+    for(int x = 0; x < 3; x++)
+    {
+        if(_fds[x] < 0) continue;
+        R = l.add_ifd(_fds[x], x ? ifd::O_READ : ifd::O_WRITE);
+        if(!R)
+        {
+            abort_spawn();
+            return R;
+        }
+        auto* f = l.query_fd(_fds[x]);
+        if(x) f->read_signal().connect(this, &process::spliced);
+        f->zero_signal().connect(this, &process::closed);
+    }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::write to the child's stdin, without blocking.
+ * \return bytes written - less than \a size (0) when the pipe is full: want_write() on i_fd(in) for its write_signal.
+ */
+expect<std::size_t> process::write(const void* data, std::size_t size)
+{
+    if(_fds[0] < 0) return rem::push_error(HERE) << " no stdin pipe";
+    auto n = ::write(_fds[0], data, size);
+    if(n < 0)
+    {
+        if(errno == EAGAIN || errno == EINTR) return 0;
+        return rem::push_error(HERE) << " write(stdin): " << std::strerror(errno);
+    }
+    return static_cast<std::size_t>(n);
+}
+
+
+/*!
+ * \brief process::close_stdin the child reads the end of its input.
+ */
+expect<> process::close_stdin()
+{
+    if(_fds[0] < 0) return rem::push_error(HERE) << " no stdin pipe";
+    (void)_listener->close_ifd(_fds[0]);
+    _fds[0] = -1;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::forward splices the stream \a s (out or err) into \a to_fd - a file or a socket - as it comes.
+ * The data does not go through user space, nor through the read_signal of the stream: do not read it there too.
+ * \a to_fd < 0 stops the forwarding. A non-blocking target that is full keeps the rest in the pipe: the child is slowed down.
+ */
+expect<> process::forward(stream s, int to_fd)
+{
+    if(s != stream::out && s != stream::err) return rem::push_error(HERE) << " only stdout and stderr are forwarded";
+    int x = s == stream::out ? 1 : 2;
+    if(_fds[x] < 0) return rem::push_error(HERE) << " no pipe on that stream";
+    unforward(x);
+    _forward[x] = to_fd;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::kill sends \a sig through the pidfd: never to another process that reused the pid.
+ */
+expect<> process::kill(int sig)
+{
+    if(!running()) return rem::push_error(HERE) << " no running child";
+    if(::syscall(SYS_pidfd_send_signal, _pidfd, sig, nullptr, 0) < 0)
+        return rem::push_error(HERE) << " pidfd_send_signal: " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+ifd* process::i_fd(stream s)
+{
+    int x = s == stream::in ? 0 : s == stream::out ? 1 : s == stream::err ? 2 : -1;
+    if(x < 0 || _fds[x] < 0 || !_listener) return nullptr;
+    return _listener->query_fd(_fds[x]);
+}
+
+
+/*!
+ * \brief process::exited the pidfd is readable, or hung up: the child terminated - reap it.
+ *
+ * ECHILD: already reaped (SIGCHLD ignored, or a waitpid(-1) elsewhere) - the status is lost, but the pidfd stays
+ * readable: it is closed all the same.
+ */
+expect<> process::exited(ifd& f)
+{
+    int st;
+    auto r = ::waitpid(_pid, &st, WNOHANG);
+    if(r == 0 || (r < 0 && errno != ECHILD)) return rem::ok;
+    if(r < 0)
+    {
+        rem::push_warning(HERE) << " process " << _pid << " was reaped elsewhere: exit status lost";
+        st = status_lost;
+    }
+    _status = st;
+    (void)_listener->close_ifd(f.fd);
+    _pidfd = -1;
+    return _exit_signal(*this);
+}
+
+
+/*!
+ * \brief process::closed end of a stream (zero-length read, or hangup): the listener closes it.
+ */
+expect<> process::closed(ifd& f)
+{
+    for(int x = 0; x < 3; x++)
+        if(_fds[x] == f.fd)
+        {
+            // Paused on a full target: the rest in the pipe is spliced by drained(), up to its end.
+            if(x && _target[x] >= 0 && f.flow.paused)
+            {
+                if(!f.state.destroy) (void)_listener->remove_ifd(f.fd);
+                return rem::ok;
+            }
+            if(!f.state.destroy) (void)_listener->close_ifd(f.fd);
+            _fds[x] = -1;
+            unforward(x);
+        }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::spliced first read_signal slot of stdout/stderr: moves the pending bytes to the forward target, if any.
+ * A full target pauses the stream (see wait_target()).
+ */
+expect<> process::spliced(ifd& f)
+{
+    int x = f.fd == _fds[1] ? 1 : 2;
+    int to = _forward[x];
+    if(to < 0) return rem::ok;
+    auto left = f.pksize;
+    while(left)
+    {
+        auto n = ::splice(f.fd, nullptr, to, nullptr, left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(n > 0) { left -= n; continue; }
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0 && errno == EAGAIN) return wait_target(x);
+        if(n < 0)
+        {
+            rem::push_error(HERE) << " splice(fd " << f.fd << " -> " << to << "): " << std::strerror(errno) << " - forwarding stopped";
+            unforward(x);
+        }
+        break;
+    }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::wait_target the forward target of stream \a x is full: its pipe is paused until the target's
+ * write_signal. The target is watched through a dup of it - the application may have the target itself in the listener.
+ */
+expect<> process::wait_target(int x)
+{
+    if(_target[x] < 0)
+    {
+        int d = ::fcntl(_forward[x], F_DUPFD_CLOEXEC, 0);
+        if(d < 0) return rem::push_error(HERE) << " dup(" << _forward[x] << "): " << std::strerror(errno);
+        auto R = _listener->add_ifd(d, ifd::O_WRITE);
+        if(!R)
+        {
+            ::close(d);
+            return R;
+        }
+        (void)_listener->pause_ifd(d); // its EPOLLOUT only.
+        auto* t = _listener->query_fd(d);
+        t->write_signal().connect(this, &process::drained);
+        t->zero_signal().connect(this, &process::target_closed);
+        _target[x] = d;
+    }
+    (void)_listener->want_write(_target[x], true);
+    return _listener->pause_ifd(_fds[x]);
+}
+
+
+/*!
+ * \brief process::drained write_signal of a full forward target: it takes more - the stream goes on.
+ */
+expect<> process::drained(ifd& f)
+{
+    int x = f.fd == _target[1] ? 1 : 2;
+    if(_target[x] != f.fd) return rem::ok;
+    (void)_listener->want_write(f.fd, false);
+    if(_listener->query_fd(_fds[x])) return _listener->resume_ifd(_fds[x]);
+
+    // The child's end closed meanwhile: the rest in the pipe, up to its end.
+    while(true)
+    {
+        auto n = ::splice(_fds[x], nullptr, _forward[x], nullptr, 1 << 16, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(n > 0) continue;
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0 && errno == EAGAIN) return _listener->want_write(f.fd, true);
+        if(n < 0) rem::push_error(HERE) << " splice(fd " << _fds[x] << " -> " << _forward[x] << "): " << std::strerror(errno);
+        break;
+    }
+    ::close(_fds[x]);
+    _fds[x] = -1;
+    unforward(x);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::target_closed error or hangup on a forward target: the forwarding stops.
+ */
+expect<> process::target_closed(ifd& f)
+{
+    for(int x = 1; x < 3; x++)
+        if(_target[x] == f.fd)
+        {
+            rem::push_error(HERE) << " forward target of fd " << _fds[x] << " closed - forwarding stopped";
+            if(_fds[x] >= 0 && !_listener->query_fd(_fds[x]))
+            {
+                ::close(_fds[x]);
+                _fds[x] = -1;
+            }
+            unforward(x);
+        }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief process::unforward stops the forwarding of stream \a x: the target's dup is closed, the stream resumed.
+ */
+void process::unforward(int x)
+{
+    if(_target[x] >= 0)
+    {
+        if(_listener && _listener->query_fd(_target[x])) (void)_listener->close_ifd(_target[x]);
+        else ::close(_target[x]);
+        _target[x] = -1;
+        if(_listener && _listener->query_fd(_fds[x])) (void)_listener->resume_ifd(_fds[x]);
+    }
+    _forward[x] = -1;
+}
+
+}
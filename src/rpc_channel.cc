@@ -0,0 +1,371 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/rpc_channel.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <cstring>
+#include <ctime>
+
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint32_t load32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+uint16_t load16(const uint8_t* p)
+{
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+}
+
+
+rpc_channel::rpc_channel(object *parent, const std::string &ii) : object(parent, ii) {}
+
+
+/*!
+ * \note The channel must be destroyed (or closed) before its listener.
+ */
+rpc_channel::~rpc_channel()
+{
+    (void)close();
+}
+
+
+/*!
+ * \brief rpc_channel::attach registers the connected stream socket \a fd in \a l - it is made non-blocking, and
+ * TCP_NODELAY for tcp: the batching is done by the channel. The channel then owns \a fd.
+ * \note The channel works through the ifd signals: the listener is run with listener::run(), not run(handler&).
+ */
+expect<> rpc_channel::attach(listener &l, int fd)
+{
+    if(_fd >= 0)
+        return rem::push_error(HERE) << " already attached to fd " << _fd;
+    if(int fl = fcntl(fd, F_GETFL); fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)
+        return rem::push_error(HERE) << " fd " << fd << ": " << std::strerror(errno);
+    int one = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // not tcp: EOPNOTSUPP, nothing to do.
+
+    _tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(_tfd < 0)
+        return rem::push_error(HERE) << " timerfd_create: " << std::strerror(errno);
+    if(auto R = l.add_ifd(fd, ifd::O_READ | ifd::O_WRITE); !R)
+    {
+        ::close(_tfd);
+        _tfd = -1;
+        return R;
+    }
+    if(auto R = l.add_ifd(_tfd, ifd::O_READ | ifd::O_MSG); !R)
+    {
+        (void)l.remove_ifd(fd);
+        ::close(_tfd);
+        _tfd = -1;
+        return R;
+    }
+    _listener = &l;
+    _fd = fd;
+    _ifd = l.query_fd(fd);
+    // Everything pending is read: the messages are bounded by max_message, the read by the socket buffer.
+    _ifd->max_pksize = ~0u;
+    _ifd->read_signal().connect(this, &rpc_channel::readable);
+    _ifd->write_signal().connect(this, &rpc_channel::writable);
+    _ifd->zero_signal().connect(this, &rpc_channel::hangup);
+    auto* t = l.query_fd(_tfd);
+    t->prio = ifd::priority::control;
+    t->read_signal().connect(this, &rpc_channel::expired);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief rpc_channel::close closes the connection at the end of the loop iteration and fails the outstanding calls with
+ * status::closed, then emits closed_signal(). The queued output is sent if the socket takes it at once.
+ */
+expect<> rpc_channel::close()
+{
+    if(_fd < 0) return rem::ok;
+    // Best effort for the replies already queued; whatever does not fit in the socket is lost.
+    if(_opos < _out.size()) (void)::send(_fd, _out.data() + _opos, _out.size() - _opos, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if(_listener->query_fd(_fd)) (void)_listener->close_ifd(_fd);
+    else ::close(_fd);
+    if(_listener->query_fd(_tfd)) (void)_listener->close_ifd(_tfd);
+    else ::close(_tfd);
+    _fd = _tfd = -1;
+    _ifd = nullptr;
+    _armed = 0;
+    // Not shrunk: a reply callback may still be reading from _in.
+    _in.clear();
+    _out.clear();
+    _ipos = _opos = 0;
+    fail_all(closed);
+    _closed_signal(*this);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief rpc_channel::call queues a request of \a method; \a done gets its reply, or the local status::timeout /
+ * status::closed. \a timeout_ms = 0: set_default_timeout(), 0 there too: no deadline.
+ * \return the correlation id of the call.
+ */
+expect<uint32_t> rpc_channel::call(uint16_t method, const void *data, std::size_t size, reply_fn done, uint32_t timeout_ms)
+{
+    if(_fd < 0)
+        return rem::push_error(HERE) << " not attached";
+    if(size > max_message)
+        return rem::push_error(HERE) << rem::overflow << " request of " << size << " bytes, max is " << max_message;
+
+    uint32_t id;
+    do{
+        id = _next_id++;
+        if(!_next_id) _next_id = 1; // 0 is never an id.
+    }while(_pending.count(id));
+
+    pending p{std::move(done), method, 0};
+    if(auto ms = timeout_ms ? timeout_ms : _default_timeout_ms)
+    {
+        p.deadline = monotonic_ns() + static_cast<uint64_t>(ms) * 1000000ull;
+        _deadlines.push({p.deadline, id});
+        if(!_armed || p.deadline < _armed) arm(p.deadline);
+    }
+    _pending.emplace(id, std::move(p));
+    queue(kind::request, id, method, ok, data, size);
+    ++_calls;
+    return id;
+}
+
+
+/*!
+ * \brief rpc_channel::reply answers the request \a id of the peer.
+ */
+expect<> rpc_channel::reply(uint32_t id, const void *data, std::size_t size, uint8_t st)
+{
+    if(_fd < 0)
+        return rem::push_error(HERE) << " not attached";
+    if(size > max_message)
+        return rem::push_error(HERE) << rem::overflow << " reply of " << size << " bytes, max is " << max_message;
+    queue(kind::reply, id, 0, st, data, size);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief rpc_channel::queue appends the message to the output, written by writable() at the end of the loop iteration.
+ */
+void rpc_channel::queue(kind k, uint32_t id, uint16_t method, uint8_t st, const void *data, std::size_t size)
+{
+    uint8_t h[header_size];
+    uint32_t v = htonl(static_cast<uint32_t>(size));
+    std::memcpy(h, &v, 4);
+    v = htonl(id);
+    std::memcpy(h + 4, &v, 4);
+    uint16_t m = htons(method);
+    std::memcpy(h + 8, &m, 2);
+    h[10] = static_cast<uint8_t>(k);
+    h[11] = st;
+    _out.insert(_out.end(), h, h + header_size);
+    if(size) _out.insert(_out.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    _listener->flush(*_ifd);
+}
+
+
+/*!
+ * \brief rpc_channel::readable reads the pending bytes and dispatches the complete messages.
+ */
+expect<> rpc_channel::readable(ifd &f)
+{
+    if(!f.pksize) return rem::ok; // continuation: nothing carried by the channel.
+    auto at = _in.size();
+    _in.resize(at + f.pksize);
+    auto n = ::read(_fd, _in.data() + at, f.pksize);
+    _in.resize(at + (n > 0 ? static_cast<std::size_t>(n) : 0));
+
+    while(_fd >= 0 && _in.size() - _ipos >= header_size)
+    {
+        const uint8_t* h = _in.data() + _ipos;
+        auto size = load32(h);
+        if(size > max_message || (h[10] != static_cast<uint8_t>(kind::request) && h[10] != static_cast<uint8_t>(kind::reply)))
+        {
+            rem::push_error(HERE) << " fd " << _fd << ": protocol error (message size " << size << ", kind " << static_cast<int>(h[10]) << ") - closing";
+            (void)close();
+            return rem::rejected;
+        }
+        if(_in.size() - _ipos < header_size + size) break;
+        _ipos += header_size + size;
+        dispatch(h, h + header_size);
+    }
+    if(_ipos == _in.size())
+    {
+        _in.clear();
+        _ipos = 0;
+    }
+    else if(_ipos > 64 * 1024 && _ipos * 2 > _in.size())
+    {
+        _in.erase(_in.begin(), _in.begin() + static_cast<std::ptrdiff_t>(_ipos));
+        _ipos = 0;
+    }
+    return rem::ok;
+}
+
+
+void rpc_channel::dispatch(const uint8_t *h, const uint8_t *data)
+{
+    message m;
+    m.size = load32(h);
+    m.id = load32(h + 4);
+    m.method = load16(h + 8);
+    m.status = h[11];
+    m.data = data;
+    if(h[10] == static_cast<uint8_t>(kind::request))
+    {
+        if(_serve) _serve(*this, m);
+        else (void)reply(m.id, nullptr, 0, unknown_method);
+        return;
+    }
+    auto it = _pending.find(m.id);
+    if(it == _pending.end()) return; // timed out already: dropped.
+    auto done = std::move(it->second.done);
+    m.method = it->second.method;
+    _pending.erase(it);
+    ++_replies;
+    if(done) done(m);
+}
+
+
+/*!
+ * \brief rpc_channel::writable writes the queued messages - called at the end of the loop iteration, and on EPOLLOUT
+ * when the socket was full.
+ */
+expect<> rpc_channel::writable(ifd &f)
+{
+    while(_opos < _out.size())
+    {
+        auto n = ::send(_fd, _out.data() + _opos, _out.size() - _opos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        ++_writes;
+        if(n < 0)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // The sent part goes: with calls queued faster than they are sent, the output would only grow.
+                if(_opos > 64 * 1024 && _opos * 2 > _out.size())
+                {
+                    _out.erase(_out.begin(), _out.begin() + static_cast<std::ptrdiff_t>(_opos));
+                    _opos = 0;
+                }
+                if(!f.flow.want_out) (void)_listener->want_write(_fd, true);
+                return rem::ok;
+            }
+            rem::push_error(HERE) << " send(fd " << _fd << "): " << std::strerror(errno) << " - closing";
+            (void)close();
+            return rem::rejected;
+        }
+        _opos += static_cast<std::size_t>(n);
+    }
+    _out.clear();
+    _opos = 0;
+    if(f.flow.want_out) (void)_listener->want_write(_fd, false);
+    return rem::ok;
+}
+
+
+expect<> rpc_channel::hangup(ifd &)
+{
+    return close();
+}
+
+
+/*!
+ * \brief rpc_channel::expired fails the calls whose deadline passed, then re-arms the timer to the next one.
+ */
+expect<> rpc_channel::expired(ifd &)
+{
+    uint64_t ticks;
+    (void)::read(_tfd, &ticks, sizeof(ticks));
+    _armed = 0;
+    auto now = monotonic_ns();
+    while(!_deadlines.empty() && _deadlines.top().deadline <= now)
+    {
+        auto e = _deadlines.top();
+        _deadlines.pop();
+        auto it = _pending.find(e.id);
+        // Replied, or an id reused since: nothing to expire.
+        if(it == _pending.end() || it->second.deadline != e.deadline) continue;
+        auto done = std::move(it->second.done);
+        message m;
+        m.id = e.id;
+        m.method = it->second.method;
+        m.status = timeout;
+        _pending.erase(it);
+        ++_timeouts;
+        if(done) done(m);
+    }
+    // The replied calls are not taken out of the heap: skip them before re-arming.
+    while(!_deadlines.empty() && !_pending.count(_deadlines.top().id)) _deadlines.pop();
+    if(_tfd >= 0 && !_deadlines.empty()) arm(_deadlines.top().deadline);
+    return rem::ok;
+}
+
+
+void rpc_channel::arm(uint64_t deadline)
+{
+    itimerspec its{};
+    its.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000ull);
+    its.it_value.tv_nsec = static_cast<long>(deadline % 1000000000ull);
+    if(timerfd_settime(_tfd, TFD_TIMER_ABSTIME, &its, nullptr) < 0)
+    {
+        rem::push_error(HERE) << " timerfd_settime: " << std::strerror(errno);
+        return;
+    }
+    _armed = deadline;
+}
+
+
+void rpc_channel::fail_all(uint8_t st)
+{
+    auto calls = std::move(_pending);
+    _pending.clear();
+    _deadlines = {};
+    for(auto& [id, p] : calls)
+    {
+        if(!p.done) continue;
+        message m;
+        m.id = id;
+        m.method = p.method;
+        m.status = st;
+        p.done(m);
+    }
+}
+
+}
@@ -0,0 +1,304 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/shm_channel.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <new>
+
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+constexpr char     shm_magic[8] = "IOSHM01";
+constexpr uint32_t pad_marker = 0xFFFFFFFF;   ///< rest of the ring up to its end is unused: wrap.
+constexpr std::size_t record_header = 8;      ///< uint32 length + 4 bytes: the payloads stay 8 bytes aligned.
+constexpr std::size_t data_offset = 4096;     ///< the header page, then the two rings.
+
+inline uint64_t record_size(std::size_t len)
+{
+    return record_header + ((len + 7) & ~uint64_t(7));
+}
+}
+
+
+shm_channel::shm_channel(object* parent, const std::string& ii): object(parent, ii)
+{
+}
+
+shm_channel::shm_channel()
+{
+}
+
+shm_channel::~shm_channel()
+{
+    if(_hdr) ::munmap(_hdr, _maplen);
+    if(_memfd >= 0) ::close(_memfd);
+    for(int e : _efd)
+    {
+        // Registered: the listener drops the ifd (and its slot into this channel) with the fd.
+        if(_listener && _listener->query_fd(e)) (void)_listener->close_ifd(e);
+        else if(e >= 0) ::close(e);
+    }
+}
+
+
+expect<> shm_channel::map(std::size_t len)
+{
+    void* p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, _memfd, 0);
+    if(p == MAP_FAILED) return rem::push_error(HERE) << " mmap(" << len << "): " << std::strerror(errno);
+    _hdr = static_cast<header*>(p);
+    _maplen = len;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::create the memfd - \a capacity bytes per direction, rounded up to a power of two - and the doorbells.
+ */
+expect<> shm_channel::create(std::size_t capacity)
+{
+    static_assert(sizeof(header) <= data_offset);
+    if(_hdr) return rem::push_error(HERE) << " channel already open";
+    std::size_t cap = min_capacity;
+    while(cap < capacity) cap <<= 1;
+
+    _memfd = ::memfd_create("iolistener-shm", MFD_CLOEXEC);
+    if(_memfd < 0) return rem::push_error(HERE) << " memfd_create: " << std::strerror(errno);
+    auto len = data_offset + 2 * cap;
+    if(::ftruncate(_memfd, static_cast<off_t>(len)) < 0)
+        return rem::push_error(HERE) << " ftruncate(" << len << "): " << std::strerror(errno);
+    auto R = map(len);
+    if(!R) return R;
+    new (_hdr) header{};
+    std::memcpy(_hdr->magic, shm_magic, sizeof(shm_magic));
+    _hdr->capacity = cap;
+
+    for(int& e : _efd)
+    {
+        e = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(e < 0) return rem::push_error(HERE) << " eventfd: " << std::strerror(errno);
+    }
+    _side = 0;
+    _mask = cap - 1;
+    auto* base = reinterpret_cast<uint8_t*>(_hdr) + data_offset;
+    _tx = base;
+    _rx = base + cap;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::open the peer side of a channel from its descriptors (see fds(), receive_from()); takes ownership of them.
+ */
+expect<> shm_channel::open(int memfd, int efd0, int efd1)
+{
+    if(_hdr) return rem::push_error(HERE) << " channel already open";
+    _memfd = memfd;
+    _efd[0] = efd0;
+    _efd[1] = efd1;
+    struct stat st;
+    if(::fstat(_memfd, &st) < 0) return rem::push_error(HERE) << " fstat: " << std::strerror(errno);
+    auto len = static_cast<std::size_t>(st.st_size);
+    if(len < data_offset + 2 * min_capacity) return rem::push_error(HERE) << " not a shm_channel: " << len << " bytes";
+    auto R = map(len);
+    if(!R) return R;
+    auto cap = _hdr->capacity;
+    if(std::memcmp(_hdr->magic, shm_magic, sizeof(shm_magic)) || (cap & (cap - 1)) || data_offset + 2 * cap != len)
+        return rem::push_error(HERE) << " not a shm_channel (bad header)";
+    _side = 1;
+    _mask = cap - 1;
+    auto* base = reinterpret_cast<uint8_t*>(_hdr) + data_offset;
+    _tx = base + cap;
+    _rx = base;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::send_to hands the channel's descriptors to the peer process. They stay open here.
+ */
+expect<> shm_channel::send_to(unix_socket& s)
+{
+    if(!_hdr) return rem::push_error(HERE) << " channel not created";
+    auto f = fds();
+    auto R = s.send_fds(f.data(), f.size());
+    if(!R) return R();
+    if(*R != f.size()) return rem::push_error(HERE) << " socket buffer full";
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::receive_from opens the channel handed by send_to() - call it when \a s is readable.
+ */
+expect<> shm_channel::receive_from(unix_socket& s)
+{
+    std::vector<int> f;
+    auto R = s.recv_fds(f);
+    if(!R) return R();
+    if(*R == unix_socket::closed) return rem::push_error(HERE) << " peer closed";
+    if(f.size() != 3)
+    {
+        for(int d : f) ::close(d);
+        return rem::push_error(HERE) << " expected 3 descriptors, received " << f.size();
+    }
+    return open(f[0], f[1], f[2]);
+}
+
+
+/*!
+ * \brief shm_channel::attach registers the receive doorbell into \a l - connect to i_fd()->read_signal() then.
+ */
+expect<> shm_channel::attach(listener& l)
+{
+    if(!_hdr) return rem::push_error(HERE) << " channel not open";
+    int efd = _efd[1 - _side];
+    auto R = l.add_ifd(efd, ifd::O_READ | ifd::O_MSG);
+    if(!R) return R;
+    _ifd = l.query_fd(efd);
+    _ifd->read_signal().connect(this, &shm_channel::doorbell);
+    _listener = &l;
+    if(!arm()) (void)::eventfd_write(efd, 1); // already something in: wake ourselves.
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::doorbell first slot of the read_signal: resets the eventfd - the messages are then recv()'d.
+ */
+expect<> shm_channel::doorbell(ifd& f)
+{
+    eventfd_t n;
+    (void)::eventfd_read(f.fd, &n);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::send copies the message into the ring; rings the peer if it sleeps.
+ * \return rem::overflow if the ring has no room - the peer is behind; try again later.
+ */
+expect<> shm_channel::send(const void* data, std::size_t size)
+{
+    if(size > max_message())
+        return rem::push_error(HERE) << " message of " << size << " bytes: max " << max_message();
+    auto& r = tx();
+    auto cap = _mask + 1;
+    auto need = record_size(size);
+    auto t = r.tail.load(std::memory_order_relaxed);
+    auto pos = t & _mask;
+    auto pad = cap - pos < need ? cap - pos : 0;
+    if(t + pad + need - _tx_head > cap)
+    {
+        _tx_head = r.head.load(std::memory_order_acquire);
+        if(t + pad + need - _tx_head > cap) return rem::overflow;
+    }
+    if(pad)
+    {
+        std::memcpy(_tx + pos, &pad_marker, sizeof(pad_marker));
+        t += pad;
+        pos = 0;
+    }
+    auto len = static_cast<uint32_t>(size);
+    std::memcpy(_tx + pos, &len, sizeof(len));
+    std::memcpy(_tx + pos + record_header, data, size);
+    // seq_cst store then seq_cst load of waiting, against arm(): one of the two sides sees the other.
+    r.tail.store(t + need);
+    if(r.waiting.load() && r.waiting.exchange(0))
+        (void)::eventfd_write(_efd[_side], 1);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief shm_channel::front the next message, in place - without arming the doorbell.
+ * \return nullptr if there is none.
+ */
+const uint8_t* shm_channel::front(uint32_t& size)
+{
+    auto& r = rx();
+    while(true)
+    {
+        auto h = r.head.load(std::memory_order_relaxed);
+        if(h == _rx_tail)
+        {
+            _rx_tail = r.tail.load(std::memory_order_acquire);
+            if(h == _rx_tail) return nullptr;
+        }
+        auto pos = h & _mask;
+        uint32_t len;
+        std::memcpy(&len, _rx + pos, sizeof(len));
+        if(len != pad_marker)
+        {
+            size = len;
+            return _rx + pos + record_header;
+        }
+        r.head.store(h + (_mask + 1 - pos), std::memory_order_release);
+    }
+}
+
+
+/*!
+ * \brief shm_channel::pop releases the message returned by front().
+ */
+void shm_channel::pop()
+{
+    auto& r = rx();
+    auto h = r.head.load(std::memory_order_relaxed);
+    uint32_t len;
+    std::memcpy(&len, _rx + (h & _mask), sizeof(len));
+    r.head.store(h + record_size(len), std::memory_order_release);
+}
+
+
+/*!
+ * \brief shm_channel::arm asks the producer to ring the doorbell on its next message - before going to sleep.
+ * \return false if a message came in meanwhile: not armed, read it.
+ */
+bool shm_channel::arm()
+{
+    auto& r = rx();
+    r.waiting.store(1);
+    if(r.tail.load() != r.head.load(std::memory_order_relaxed))
+    {
+        r.waiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+
+/*!
+ * \brief shm_channel::recv copies the next message into \a data - truncated to \a size, the rest is discarded.
+ * \return message bytes copied; 0 if there is none: the doorbell is then armed.
+ */
+expect<std::size_t> shm_channel::recv(void* data, std::size_t size)
+{
+    uint32_t len;
+    const uint8_t* p;
+    while(!(p = front(len)))
+        if(arm()) return 0;
+    auto n = std::min<std::size_t>(len, size);
+    std::memcpy(data, p, n);
+    pop();
+    return n;
+}
+
+}
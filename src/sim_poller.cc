@@ -0,0 +1,288 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/sim_poller.h"
+#include <algorithm>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+sim_poller::entry *sim_poller::query(int fd)
+{
+    if(fd < first_fd) return nullptr;
+    auto x = static_cast<std::size_t>(fd - first_fd);
+    if(x >= _fds.size() || !_fds[x].used) return nullptr;
+    return &_fds[x];
+}
+
+
+/*!
+ * \brief sim_poller::readiness the events \a e would report now - level-triggered, as epoll.
+ */
+uint32_t sim_poller::readiness(const entry &e) const
+{
+    if(!e.f) return 0;
+    uint32_t r = e.raised & (e.mask | EPOLLERR | EPOLLHUP);
+    if((e.mask & EPOLLIN) && e.pending()) r |= EPOLLIN;
+    if(e.hup) r |= EPOLLHUP;
+    else if(e.mask & EPOLLOUT) r |= EPOLLOUT; // memory pipes do not fill up.
+    return r;
+}
+
+
+void sim_poller::enqueue(int fd, entry &e)
+{
+    if(e.queued || !readiness(e)) return;
+    e.queued = true;
+    _queue.push_back(fd);
+}
+
+
+/*!
+ * \brief sim_poller::open creates a virtual descriptor; its data comes from inject() and its output goes to output().
+ * \return the descriptor number - the lowest free one.
+ */
+int sim_poller::open()
+{
+    int fd;
+    if(!_free.empty())
+    {
+        fd = _free.back();
+        _free.pop_back();
+    }
+    else
+    {
+        fd = first_fd + static_cast<int>(_fds.size());
+        _fds.emplace_back();
+    }
+    _fds[fd - first_fd].used = true;
+    ++_open;
+    return fd;
+}
+
+
+/*!
+ * \brief sim_poller::pair creates two connected descriptors - the memory socketpair: write() on one injects in the other,
+ * closing one hangs up the other.
+ */
+bool sim_poller::pair(int fds[2])
+{
+    fds[0] = open();
+    fds[1] = open();
+    query(fds[0])->peer = fds[1];
+    query(fds[1])->peer = fds[0];
+    return true;
+}
+
+
+expect<> sim_poller::add(ifd &f, uint32_t events)
+{
+    auto* e = query(f.fd);
+    if(!e)
+        return rem::push_error(HERE) << " fd " << f.fd << " is not a sim_poller descriptor (see sim_poller::open())";
+    if(e->f)
+        return rem::push_error(HERE) << " fd " << f.fd << " already in the poll set";
+    e->f = &f;
+    e->mask = events;
+    // The bytes are handed in place, in memory the poller owns.
+    f.options |= ifd::O_MEM | ifd::O_XBUF;
+    enqueue(f.fd, *e);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief sim_poller::modify changes the registered events.
+ *
+ * Taking EPOLLIN out of a descriptor that has bytes delivered in the current batch, and not yet dispatched (paused by an
+ * earlier handler of the batch - see listener::pause_ifd()), takes those bytes back: they are delivered again once resumed,
+ * as they would still be in the kernel with epoll.
+ */
+expect<> sim_poller::modify(ifd &f, uint32_t events)
+{
+    auto* e = query(f.fd);
+    if(!e || e->f != &f)
+        return rem::push_error(HERE) << " fd " << f.fd << " not in the poll set";
+    if((e->mask & EPOLLIN) && !(events & EPOLLIN) && e->batch == _batch && e->given && f.state.queued)
+    {
+        e->head -= e->given;
+        e->given = 0;
+        f.pksize = 0;
+    }
+    e->mask = events;
+    enqueue(f.fd, *e);
+    return rem::ok;
+}
+
+
+expect<> sim_poller::remove(ifd &f)
+{
+    if(auto* e = query(f.fd); e && e->f == &f)
+    {
+        e->f = nullptr;
+        e->mask = 0;
+        e->raised = 0;
+    }
+    return rem::ok;
+}
+
+
+/*!
+ * \brief sim_poller::wait reports up to \a max ready descriptors, in the order they became ready, and hands their
+ * pending bytes - at most the delivery size or ifd::budget per event. \a timeout is ignored: see set_driver().
+ */
+int sim_poller::wait(epoll_event *events, int max, int)
+{
+    ++_batch;
+    if(_qhead == _queue.size() && _driver) _driver();
+
+    int n = 0;
+    auto end = _queue.size(); // descriptors re-queued by this wait are for the next one.
+    while(n < max && _qhead < end)
+    {
+        int fd = _queue[_qhead++];
+        auto* e = query(fd);
+        // Closed, or a stale entry of a reused number already reported by this wait.
+        if(!e || e->batch == _batch) continue;
+        e->queued = false;
+        auto ev = readiness(*e);
+        if(!ev) continue;
+        e->batch = _batch;
+        e->given = 0;
+        if(ev & EPOLLIN)
+        {
+            // The previous batch is over: the bytes of cur it was handed are consumed.
+            if(e->head == e->cur.size())
+            {
+                e->cur.clear();
+                e->head = 0;
+                e->cur.swap(e->in);
+            }
+            auto size = e->f->budget ? std::min<std::size_t>(_chunk, e->f->budget) : _chunk;
+            auto count = std::min(size, e->cur.size() - e->head);
+            e->f->internal_buffer = e->cur.data() + e->head;
+            e->f->pksize = count;
+            e->head += count;
+            e->given = count;
+            _bytes += count;
+        }
+        e->raised = 0;
+        events[n].events = ev;
+        events[n].data.ptr = e->f;
+        ++n;
+        enqueue(fd, *e);
+    }
+    if(_qhead == _queue.size())
+    {
+        _queue.clear();
+        _qhead = 0;
+    }
+    else if(_qhead > 4096 && _qhead * 2 > _queue.size())
+    {
+        _queue.erase(_queue.begin(), _queue.begin() + static_cast<std::ptrdiff_t>(_qhead));
+        _qhead = 0;
+    }
+    _events += static_cast<uint64_t>(n);
+    return n;
+}
+
+
+/*!
+ * \brief sim_poller::close_fd releases the descriptor - its number is reused by the next open(); the peer of a pair()
+ * is hung up.
+ */
+void sim_poller::close_fd(int fd)
+{
+    auto* e = query(fd);
+    if(!e) return;
+    if(auto* p = query(e->peer))
+    {
+        p->peer = -1;
+        hangup(e->peer);
+    }
+    *e = entry();
+    _free.push_back(fd);
+    --_open;
+}
+
+
+/*!
+ * \brief sim_poller::inject queues \a n bytes on the input of \a fd - what the remote end would have sent.
+ */
+expect<> sim_poller::inject(int fd, const void *data, std::size_t n)
+{
+    auto* e = query(fd);
+    if(!e)
+        return rem::push_error(HERE) << " fd " << fd << " is not a sim_poller descriptor";
+    if(e->hup) return rem::rejected;
+    auto* b = static_cast<const uint8_t*>(data);
+    e->in.insert(e->in.end(), b, b + n);
+    enqueue(fd, *e);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief sim_poller::write sends \a n bytes from \a fd: to its peer (pair()), or to its output() otherwise.
+ */
+expect<> sim_poller::write(int fd, const void *data, std::size_t n)
+{
+    auto* e = query(fd);
+    if(!e)
+        return rem::push_error(HERE) << " fd " << fd << " is not a sim_poller descriptor";
+    if(e->peer >= 0) return inject(e->peer, data, n);
+    auto* b = static_cast<const uint8_t*>(data);
+    e->out.insert(e->out.end(), b, b + n);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief sim_poller::hangup the remote end is gone: EPOLLHUP - after the pending bytes, which are still delivered.
+ */
+void sim_poller::hangup(int fd)
+{
+    auto* e = query(fd);
+    if(!e) return;
+    e->hup = true;
+    enqueue(fd, *e);
+}
+
+
+/*!
+ * \brief sim_poller::ready raises \a events (EPOLLPRI, EPOLLERR, ...) on \a fd - reported once, by the next wait.
+ */
+void sim_poller::ready(int fd, uint32_t events)
+{
+    auto* e = query(fd);
+    if(!e) return;
+    e->raised |= events;
+    enqueue(fd, *e);
+}
+
+
+/*!
+ * \brief sim_poller::output the bytes written on \a fd (not paired) - the caller may clear it.
+ */
+std::vector<uint8_t> *sim_poller::output(int fd)
+{
+    auto* e = query(fd);
+    return e ? &e->out : nullptr;
+}
+
+}
@@ -0,0 +1,236 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+#include "iolistener/topology.h"
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49 // linux 3.19 - not yet in every libc's headers.
+#endif
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+std::string read_line(const std::string& path)
+{
+    std::ifstream in(path);
+    std::string s;
+    std::getline(in, s);
+    return s;
+}
+
+constexpr std::size_t mask_bits = 1024; ///< nodes in the masks given to the kernel.
+}
+
+
+/*!
+ * \brief topology::load reads the cpus of each NUMA node from /sys.
+ */
+expect<> topology::load()
+{
+    _node_of.clear();
+    _cpus.clear();
+    if(DIR* d = opendir("/sys/devices/system/node"))
+    {
+        while(auto* e = readdir(d))
+        {
+            int n;
+            if(std::strncmp(e->d_name, "node", 4) || std::sscanf(e->d_name + 4, "%d", &n) != 1) continue;
+            if(static_cast<std::size_t>(n) >= _cpus.size()) _cpus.resize(static_cast<std::size_t>(n) + 1);
+            _cpus[n] = parse_cpulist(read_line("/sys/devices/system/node/" + std::string(e->d_name) + "/cpulist"));
+        }
+        closedir(d);
+    }
+    if(_cpus.empty())
+    {
+        // No NUMA in this kernel: one node.
+        _cpus.emplace_back();
+        for(long c = 0; c < sysconf(_SC_NPROCESSORS_CONF); c++) _cpus[0].push_back(static_cast<int>(c));
+    }
+    for(std::size_t n = 0; n < _cpus.size(); n++)
+        for(int c : _cpus[n])
+        {
+            if(static_cast<std::size_t>(c) >= _node_of.size()) _node_of.resize(static_cast<std::size_t>(c) + 1, -1);
+            _node_of[c] = static_cast<int>(n);
+        }
+    return rem::ok;
+}
+
+
+int topology::node_of(int cpu) const
+{
+    if(cpu < 0 || static_cast<std::size_t>(cpu) >= _node_of.size()) return -1;
+    return _node_of[cpu];
+}
+
+
+const std::vector<int>& topology::cpus(int node) const
+{
+    static const std::vector<int> none;
+    if(node < 0 || static_cast<std::size_t>(node) >= _cpus.size()) return none;
+    return _cpus[node];
+}
+
+
+/*!
+ * \brief topology::parse_cpulist the kernel's cpu list format: "0-3,8,10-11".
+ */
+std::vector<int> topology::parse_cpulist(const std::string& list)
+{
+    std::vector<int> cpus;
+    const char* p = list.c_str();
+    while(*p)
+    {
+        char* end;
+        long a = std::strtol(p, &end, 10);
+        if(end == p) break;
+        long b = a;
+        p = end;
+        if(*p == '-')
+        {
+            b = std::strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for(long c = a; c <= b; c++) cpus.push_back(static_cast<int>(c));
+        if(*p == ',') ++p;
+        else break;
+    }
+    return cpus;
+}
+
+
+/*!
+ * \brief topology::irq_cpus the cpus the interrupts of \a ifname are delivered to - the union of the effective affinity
+ * of its MSI vectors (/sys/class/net/<ifname>/device/msi_irqs, /proc/irq/<n>/). Empty for a virtual interface.
+ */
+std::vector<int> topology::irq_cpus(const std::string& ifname)
+{
+    std::vector<int> cpus;
+    DIR* d = opendir(("/sys/class/net/" + ifname + "/device/msi_irqs").c_str());
+    if(!d) return cpus;
+    while(auto* e = readdir(d))
+    {
+        if(e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        auto irq = "/proc/irq/" + std::string(e->d_name);
+        auto list = read_line(irq + "/effective_affinity_list");
+        if(list.empty()) list = read_line(irq + "/smp_affinity_list");
+        for(int c : parse_cpulist(list)) cpus.push_back(c);
+    }
+    closedir(d);
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+
+/*!
+ * \brief topology::incoming_cpu the cpu that processed the last packets of the socket (SO_INCOMING_CPU) - the one its
+ * flow is steered to.
+ */
+expect<int> topology::incoming_cpu(int fd)
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if(getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+        return rem::push_error(HERE) << " SO_INCOMING_CPU(fd " << fd << "): " << std::strerror(errno);
+    return cpu;
+}
+
+
+int topology::current_cpu()
+{
+    return sched_getcpu();
+}
+
+
+expect<> topology::pin(pthread_t thread, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(int e = pthread_setaffinity_np(thread, sizeof(set), &set))
+        return rem::push_warning(HERE) << " cannot pin the thread to cpu " << cpu << ": " << std::strerror(e);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief topology::prefer_node the memory the calling thread touches first from now on comes from \a node, while it
+ * has free pages (MPOL_PREFERRED).
+ */
+expect<> topology::prefer_node(int node)
+{
+    if(node < 0 || static_cast<std::size_t>(node) >= mask_bits)
+        return rem::push_error(HERE) << " invalid node " << node;
+    unsigned long mask[mask_bits / (8 * sizeof(unsigned long))]{};
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+    if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, mask_bits + 1) < 0)
+        return rem::push_warning(HERE) << " set_mempolicy(node " << node << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief topology::bind places the pages of [addr, addr+size) - page-aligned - on \a node; with \a move, the pages
+ * already there are migrated.
+ */
+expect<> topology::bind(void* addr, std::size_t size, int node, bool move)
+{
+    if(node < 0 || static_cast<std::size_t>(node) >= mask_bits)
+        return rem::push_error(HERE) << " invalid node " << node;
+    unsigned long mask[mask_bits / (8 * sizeof(unsigned long))]{};
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+    if(syscall(SYS_mbind, addr, size, MPOL_PREFERRED, mask, mask_bits + 1, move ? MPOL_MF_MOVE : 0) < 0)
+        return rem::push_warning(HERE) << " mbind(node " << node << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief topology::alloc \a size bytes of anonymous memory placed on \a node (-1: the default policy). Free with release().
+ */
+void* topology::alloc(std::size_t size, int node)
+{
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+    {
+        rem::push_error(HERE) << " mmap(" << size << "): " << std::strerror(errno);
+        return nullptr;
+    }
+    if(node >= 0) (void)bind(p, size, node, false);
+    return p;
+}
+
+
+void topology::release(void* addr, std::size_t size)
+{
+    if(addr) munmap(addr, size);
+}
+
+}
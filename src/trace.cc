@@ -0,0 +1,315 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+
+#include "iolistener/trace.h"
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+
+using namespace book;
+
+namespace io
+{
+
+namespace
+{
+constexpr char magic[8] = {'I','O','T','R','A','C','E','1'};
+
+uint64_t steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+
+trace_writer::trace_writer(uint32_t max_payload): _max_payload(max_payload), _peek(max_payload)
+{
+}
+
+trace_writer::~trace_writer()
+{
+    (void)close();
+}
+
+
+expect<> trace_writer::open(const std::string& path, std::size_t capacity)
+{
+    if(_map) return rem::push_error(HERE) << " trace already open";
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(_fd < 0)
+        return rem::push_error(HERE) << " open(" << path << "): " << std::strerror(errno);
+    _capacity = std::max(capacity, sizeof(trace::file_header) + sizeof(trace::record) + _max_payload);
+    void* m = MAP_FAILED;
+    if(::ftruncate(_fd, static_cast<off_t>(_capacity)) == 0)
+        m = ::mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if(m == MAP_FAILED)
+    {
+        auto err = errno;
+        ::close(_fd);
+        _fd = -1;
+        return rem::push_error(HERE) << " ftruncate/mmap(" << path << "): " << std::strerror(err);
+    }
+    _map = static_cast<uint8_t*>(m);
+
+    auto* h = reinterpret_cast<trace::file_header*>(_map);
+    std::memcpy(h->magic, magic, sizeof(magic));
+    h->version = 1;
+    h->record_size = sizeof(trace::record);
+    h->start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    _end = h->end = sizeof(trace::file_header);
+    _t0 = steady_ns();
+    _records = 0;
+    rem::push_info(HERE) << " recording io trace into " << path;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief trace_writer::close cuts the file to the recorded size and unmaps it.
+ */
+expect<> trace_writer::close()
+{
+    if(!_map) return rem::ok;
+    ::munmap(_map, _capacity);
+    _map = nullptr;
+    if(::ftruncate(_fd, static_cast<off_t>(_end)) < 0)
+        rem::push_warning(HERE) << " ftruncate: " << std::strerror(errno);
+    ::close(_fd);
+    _fd = -1;
+    return rem::ok;
+}
+
+
+bool trace_writer::grow(std::size_t need)
+{
+    auto cap = std::max(_capacity * 2, _end + need);
+    if(::ftruncate(_fd, static_cast<off_t>(cap)) < 0) return false;
+    void* m = ::mremap(_map, _capacity, cap, MREMAP_MAYMOVE);
+    if(m == MAP_FAILED) return false;
+    _map = static_cast<uint8_t*>(m);
+    _capacity = cap;
+    return true;
+}
+
+
+/*!
+ * \brief trace_writer::event starts the record of one listener event on \a f, before it is dispatched - commit() ends it.
+ *
+ * On read events the pending bytes are peeked - the descriptor is left untouched for the handlers. Descriptors that are
+ * not sockets (tty, pipe) are recorded without payload; memory descriptors (O_MEM) with the bytes the poller put in the
+ * internal buffer.
+ */
+void trace_writer::event(ifd& f, uint32_t events)
+{
+    if(!_map) return;
+    _rec = {steady_ns() - _t0, f.fd, events, 0, 0};
+    _stream = false;
+    _open = true;
+    if(events && !(events & (EPOLLIN | EPOLLPRI))) return;
+
+    if(f.options & ifd::O_MEM)
+    {
+        if(!events) return; // continuation: nothing new delivered.
+        _rec.bytes = static_cast<uint32_t>(f.pksize);
+        _rec.size = std::min(_rec.bytes, _max_payload);
+        std::memcpy(_peek.data(), f.internal_buffer, _rec.size);
+        return;
+    }
+    std::size_t cap = _max_payload;
+    if(!(f.options & ifd::O_MSG))
+    {
+        int n = 0;
+        if(!::ioctl(f.fd, FIONREAD, &n) && n > 0) _rec.bytes = static_cast<uint32_t>(n);
+        cap = std::min(_rec.bytes, _max_payload);
+        _stream = true;
+    }
+    if(!cap) return;
+    auto n = ::recv(f.fd, _peek.data(), cap, MSG_PEEK | MSG_DONTWAIT);
+    if(n > 0) _rec.size = static_cast<uint32_t>(n);
+    if(f.options & ifd::O_MSG) _rec.bytes = _rec.size;
+}
+
+
+/*!
+ * \brief trace_writer::commit appends the record started by event(), after the dispatch: the payload of a stream socket is
+ * cut to the bytes the dispatch consumed - the rest is recorded by the event that reads it.
+ *
+ * With I_AUTOFILL the listener did the read: the count is exact. Otherwise it is the FIONREAD difference, checked against
+ * what is still pending when bytes arrived during the dispatch (see consumed()).
+ */
+void trace_writer::commit(ifd& f)
+{
+    if(!_open) return;
+    _open = false;
+    int n = 0;
+    if(_stream && (f.options & ifd::I_AUTOFILL))
+        _rec.size = std::min(_rec.size, static_cast<uint32_t>(_rec.events ? f.pksize : 0)); // read by the listener: exact.
+    // Failing: the fd was closed by the handlers - all consumed.
+    else if(_stream && _rec.size && !::ioctl(f.fd, FIONREAD, &n))
+    {
+        auto left = n > 0 ? static_cast<uint32_t>(n) : 0u;
+        uint32_t c = _rec.bytes > left ? _rec.bytes - left : 0;
+        if(c < _rec.size && left) _rec.size = consumed(f.fd, c);
+        else _rec.size = std::min(c, _rec.size);
+    }
+    auto need = sizeof(trace::record) + trace::padded(_rec.size);
+    if(_end + need > _capacity && !grow(need)) return; // dropped: the file could not grow.
+
+    auto* r = reinterpret_cast<trace::record*>(_map + _end);
+    *r = _rec;
+    if(_rec.size) std::memcpy(r + 1, _peek.data(), _rec.size);
+    _end += need;
+    reinterpret_cast<trace::file_header*>(_map)->end = _end;
+    ++_records;
+}
+
+
+/*!
+ * \brief trace_writer::consumed the bytes of the peeked payload consumed by the dispatch, at least \a c: bytes arriving
+ * meanwhile make the FIONREAD difference fall short - the pending ones then start further in the payload.
+ * \note Arrivals that repeat the consumed bytes exactly are mistaken for them: the record is then cut short.
+ */
+uint32_t trace_writer::consumed(int fd, uint32_t c)
+{
+    _left.resize(_rec.size);
+    auto n = ::recv(fd, _left.data(), _rec.size - c, MSG_PEEK | MSG_DONTWAIT);
+    if(n <= 0) return _rec.size;
+    for(; c < _rec.size; c++)
+    {
+        auto len = std::min<std::size_t>(static_cast<std::size_t>(n), _rec.size - c);
+        if(!std::memcmp(_peek.data() + c, _left.data(), len)) return c;
+    }
+    return _rec.size;
+}
+
+
+/*!
+ * \brief trace_writer::append records an event with the given payload - for sources that do not go through event().
+ */
+void trace_writer::append(int fd, uint32_t events, const void* data, uint32_t size, uint32_t bytes)
+{
+    if(!_map) return;
+    auto need = sizeof(trace::record) + trace::padded(size);
+    if(_end + need > _capacity && !grow(need)) return;
+    auto* r = reinterpret_cast<trace::record*>(_map + _end);
+    r->ns = steady_ns() - _t0;
+    r->fd = fd;
+    r->events = events;
+    r->bytes = bytes;
+    r->size = size;
+    if(size) std::memcpy(r + 1, data, size);
+    _end += need;
+    reinterpret_cast<trace::file_header*>(_map)->end = _end;
+    ++_records;
+}
+
+
+trace_replay::~trace_replay()
+{
+    if(_map) ::munmap(_map, _size);
+    if(_fd >= 0) ::close(_fd);
+}
+
+
+expect<> trace_replay::open(const std::string& path)
+{
+    _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(_fd < 0)
+        return rem::push_error(HERE) << " open(" << path << "): " << std::strerror(errno);
+    struct stat st{};
+    if(::fstat(_fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(trace::file_header))
+        return rem::push_error(HERE) << " " << path << " is not an io trace";
+    _size = static_cast<std::size_t>(st.st_size);
+    // Private, writable mapping: the handlers get a writable internal_buffer, the file is never modified.
+    void* m = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+    if(m == MAP_FAILED)
+        return rem::push_error(HERE) << " mmap(" << path << "): " << std::strerror(errno);
+    _map = static_cast<uint8_t*>(m);
+    auto* h = reinterpret_cast<trace::file_header*>(_map);
+    if(std::memcmp(h->magic, magic, sizeof(magic)) || h->record_size != sizeof(trace::record))
+        return rem::push_error(HERE) << " " << path << " is not an io trace (or not this version)";
+    if(h->end < _size) _size = h->end; // what was recorded, past that is unused capacity.
+    return rem::ok;
+}
+
+
+ifd* trace_replay::add(int fd_, uint32_t opt_)
+{
+    return _ifds.add(fd_, opt_ | ifd::O_XBUF);
+}
+
+
+/*!
+ * \brief trace_replay::play dispatches the records to the handlers of the add()'ed descriptors; other fds are skipped.
+ * \param speed 1.0 replays at the recorded pace, 2.0 twice as fast...; 0 as fast as the handlers go.
+ * \return number of records dispatched. A rem::end from a handler stops the replay.
+ */
+expect<uint64_t> trace_replay::play(double speed)
+{
+    if(!_map) return rem::push_error(HERE) << " no trace";
+    uint64_t played = 0;
+    auto wall0 = steady_ns();
+    std::size_t off = sizeof(trace::file_header);
+    while(off + sizeof(trace::record) <= _size)
+    {
+        auto* r = reinterpret_cast<trace::record*>(_map + off);
+        auto* payload = reinterpret_cast<uint8_t*>(r + 1);
+        off += sizeof(trace::record);
+        if(r->size > _size - off)
+            return rem::push_error(HERE) << " truncated trace: the record at offset " << off - sizeof(trace::record)
+                                         << " claims " << r->size << " bytes";
+        off += trace::padded(r->size);
+        ifd* f = _ifds.query(r->fd);
+        if(!f) continue;
+        if(speed > 0)
+        {
+            auto at = wall0 + static_cast<uint64_t>(r->ns / speed);
+            auto now = steady_ns();
+            if(at > now) std::this_thread::sleep_for(std::chrono::nanoseconds(at - now));
+        }
+        ++played;
+        // In the order of listener::dispatch(): write, read, then the end of stream - an empty read before a hangup is
+        // the end of stream itself.
+        bool hup = r->events & (EPOLLERR | EPOLLHUP);
+        expect<> R;
+        if(r->events & EPOLLOUT)
+        {
+            R = f->write_signal()(*f);
+            if(R && *R == rem::end) break;
+        }
+        if(r->size || !r->events || (!hup && (r->events & (EPOLLIN | EPOLLPRI))))
+        {
+            f->options |= ifd::O_XBUF;
+            f->internal_buffer = payload;
+            f->pksize = r->size;
+            R = f->read_signal()(*f);
+            if(R && *R == rem::end) break;
+        }
+        if(hup)
+        {
+            R = f->zero_signal()(*f);
+            if(R && *R == rem::end) break;
+        }
+    }
+    return played;
+}
+
+}
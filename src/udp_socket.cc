@@ -0,0 +1,326 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+
+#include "iolistener/udp_socket.h"
+#include <netdb.h>
+#include <algorithm>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+udp_socket::udp_socket(object* parent, const std::string& ii): object(parent,ii)
+{
+}
+
+udp_socket::udp_socket()
+{
+}
+
+udp_socket::~udp_socket()
+{
+    _batch_signal.disconnect_all();
+    // Registered: the listener drops the ifd (and its slot into this socket) with the fd.
+    if(m_listener && m_listener->query_fd(m_fd)) (void)m_listener->close_ifd(m_fd);
+    else if(m_fd >= 0) ::close(m_fd);
+}
+
+
+int udp_socket::create(int family)
+{
+    m_fd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_fd < 0)
+    {
+        rem::push_error(HERE) << " socket(SOCK_DGRAM): " << std::strerror(errno);
+        return m_fd;
+    }
+    m_family = family;
+    if(!m_count) (void)set_batch(default_batch, default_slot);
+    return m_fd;
+}
+
+
+/*!
+ * \brief udp_socket::mkaddr resolves \a addr - "host:port", "[v6 address]:port", "*" for the wildcard host or any port -
+ * in the family of the socket ( create() ).
+ * \return the address length.
+ */
+expect<socklen_t> udp_socket::mkaddr(const std::string& addr, sockaddr_storage& a, bool passive) const
+{
+    auto colon = addr.rfind(':');
+    if(colon == std::string::npos)
+        return rem::push_error(HERE) << " invalid address '" << addr << "': expected host:port";
+    std::string host = addr.substr(0, colon);
+    std::string service = addr.substr(colon + 1);
+    if(host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+    addrinfo hints{};
+    hints.ai_family = m_family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* res = nullptr;
+    int e = ::getaddrinfo(host == "*" ? nullptr : host.c_str(), service == "*" ? "0" : service.c_str(), &hints, &res);
+    if(e || !res)
+        return rem::push_error(HERE) << " invalid address '" << addr << "': " << ::gai_strerror(e);
+    socklen_t len = res->ai_addrlen;
+    std::memcpy(&a, res->ai_addr, len);
+    ::freeaddrinfo(res);
+    return len;
+}
+
+
+expect<> udp_socket::bind(const std::string& addr)
+{
+    if(m_fd < 0 && create() < 0) return rem::push_error(HERE) << " no socket";
+    sockaddr_storage a{};
+    auto len = mkaddr(addr, a, true);
+    if(!len) return len();
+    if(::bind(m_fd, reinterpret_cast<sockaddr*>(&a), *len) < 0)
+        return rem::push_error(HERE) << " bind(" << addr << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief udp_socket::connect sets the default destination - datagrams sent with a null address go there.
+ */
+expect<> udp_socket::connect(const std::string& addr)
+{
+    if(m_fd < 0 && create() < 0) return rem::push_error(HERE) << " no socket";
+    sockaddr_storage a{};
+    auto len = mkaddr(addr, a, false);
+    if(!len) return len();
+    if(::connect(m_fd, reinterpret_cast<sockaddr*>(&a), *len) < 0)
+        return rem::push_error(HERE) << " connect(" << addr << "): " << std::strerror(errno);
+    return rem::ok;
+}
+
+
+uint16_t udp_socket::port() const
+{
+    sockaddr_storage a{};
+    socklen_t len = sizeof(a);
+    if(getsockname(m_fd, reinterpret_cast<sockaddr*>(&a), &len) < 0) return 0;
+    if(a.ss_family == AF_INET6) return ntohs(reinterpret_cast<sockaddr_in6*>(&a)->sin6_port);
+    return ntohs(reinterpret_cast<sockaddr_in*>(&a)->sin_port);
+}
+
+
+/*!
+ * \brief udp_socket::set_batch allocates the receive pool: \a count slots of \a slot_size bytes, and the recvmmsg headers.
+ *
+ * The headers point once and for all into the pool, the source addresses and control buffers - receive() only resets
+ * the lengths the kernel overwrites.
+ */
+expect<> udp_socket::set_batch(std::size_t count, std::size_t slot_size)
+{
+    if(!count || !slot_size) return rem::push_error(HERE) << " empty batch";
+    m_count = count;
+    m_slot  = slot_size;
+    m_pool.reset(new uint8_t[count * slot_size]);
+    m_rx.assign(count, mmsghdr{});
+    m_rxiov.assign(count, iovec{});
+    m_rxaddr.assign(count, sockaddr_storage{});
+    m_rxcmsg.assign(count * CMSG_SPACE(sizeof(int)), 0);
+    for(std::size_t x = 0; x < count; x++)
+    {
+        m_rxiov[x].iov_base = m_pool.get() + x * slot_size;
+        m_rxiov[x].iov_len  = slot_size;
+        auto& h = m_rx[x].msg_hdr;
+        h.msg_iov     = &m_rxiov[x];
+        h.msg_iovlen  = 1;
+        h.msg_name    = &m_rxaddr[x];
+        h.msg_control = m_rxcmsg.data() + x * CMSG_SPACE(sizeof(int));
+    }
+    m_batch.reserve(count);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief udp_socket::enable_gro lets the kernel coalesce datagrams of a flow into one slot (linux 5.0+).
+ *
+ * The slots are grown to gro_slot bytes. If the kernel refuses, the socket keeps receiving one datagram per slot.
+ */
+expect<> udp_socket::enable_gro()
+{
+    int one = 1;
+    if(setsockopt(m_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+        return rem::push_warning(HERE) << " UDP_GRO not available: " << std::strerror(errno);
+    m_gro = true;
+    if(m_slot < gro_slot) return set_batch(m_count, gro_slot);
+    return rem::ok;
+}
+
+
+expect<> udp_socket::attach(listener& l)
+{
+    if(m_fd < 0) return rem::push_error(HERE) << " no socket";
+    auto R = l.add_ifd(m_fd, ifd::O_READ | ifd::O_MSG);
+    if(!R) return R;
+    m_ifd = l.query_fd(m_fd);
+    m_ifd->read_signal().connect(this, &udp_socket::data_in);
+    m_listener = &l;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief udp_socket::receive one recvmmsg() call; the received datagrams are in the batch handed to batch_signal().
+ * \return number of datagrams (GRO segments counted separately); 0 if nothing was pending.
+ */
+expect<std::size_t> udp_socket::receive()
+{
+    m_batch.clear();
+    for(auto& m : m_rx)
+    {
+        m.msg_hdr.msg_namelen    = sizeof(sockaddr_storage);
+        m.msg_hdr.msg_controllen = m_gro ? CMSG_SPACE(sizeof(int)) : 0;
+        m.msg_hdr.msg_flags      = 0;
+    }
+    int n = recvmmsg(m_fd, m_rx.data(), static_cast<unsigned>(m_count), MSG_DONTWAIT, nullptr);
+    ++m_calls;
+    if(n < 0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        return rem::push_error(HERE) << " recvmmsg: " << std::strerror(errno);
+    }
+
+    for(int x = 0; x < n; x++)
+    {
+        auto& h = m_rx[x].msg_hdr;
+        std::size_t len = m_rx[x].msg_len;
+        std::size_t seg = 0;
+        if(m_gro)
+        {
+            for(cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c))
+                if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO)
+                {
+                    int s;
+                    std::memcpy(&s, CMSG_DATA(c), sizeof(s));
+                    seg = s > 0 ? static_cast<std::size_t>(s) : 0;
+                }
+        }
+        auto* base = static_cast<uint8_t*>(m_rxiov[x].iov_base);
+        if(!seg || seg >= len)
+        {
+            m_batch.push_back({base, len, &m_rxaddr[x], h.msg_namelen});
+            continue;
+        }
+        for(std::size_t off = 0; off < len; off += seg)
+            m_batch.push_back({base + off, std::min(seg, len - off), &m_rxaddr[x], h.msg_namelen});
+    }
+    m_datagrams += m_batch.size();
+    return m_batch.size();
+}
+
+
+expect<> udp_socket::data_in(ifd&)
+{
+    auto R = receive();
+    if(!R) return R();
+    if(!*R) return rem::ok;
+    return _batch_signal(m_batch);
+}
+
+
+/*!
+ * \brief udp_socket::send sends \a n datagrams with as few sendmmsg() calls as the kernel takes.
+ * \return number of datagrams sent - less than n if the socket buffer is full.
+ */
+expect<std::size_t> udp_socket::send(const datagram* d, std::size_t n)
+{
+    if(m_tx.size() < n)
+    {
+        m_tx.resize(n);
+        m_txiov.resize(n);
+    }
+    for(std::size_t x = 0; x < n; x++)
+    {
+        m_txiov[x].iov_base = d[x].data;
+        m_txiov[x].iov_len  = d[x].size;
+        auto& h = m_tx[x].msg_hdr;
+        h = msghdr{};
+        h.msg_iov     = &m_txiov[x];
+        h.msg_iovlen  = 1;
+        h.msg_name    = const_cast<sockaddr_storage*>(d[x].from);
+        h.msg_namelen = d[x].from ? d[x].fromlen : 0;
+    }
+    std::size_t sent = 0;
+    while(sent < n)
+    {
+        int r = sendmmsg(m_fd, m_tx.data() + sent, static_cast<unsigned>(n - sent), MSG_DONTWAIT);
+        if(r < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if(errno == EINTR) continue;
+            if(!sent) return rem::push_error(HERE) << " sendmmsg: " << std::strerror(errno);
+            break;
+        }
+        sent += r;
+    }
+    return sent;
+}
+
+
+/*!
+ * \brief udp_socket::send_segmented sends \a data as datagrams of \a segment bytes in one call, using UDP_SEGMENT (linux 4.18+).
+ *
+ * Falls back to send() of the segments when the kernel does not offer UDP GSO.
+ * \return number of bytes sent.
+ */
+expect<std::size_t> udp_socket::send_segmented(const uint8_t* data, std::size_t size, uint16_t segment,
+                                                const sockaddr_storage* to, socklen_t tolen)
+{
+    if(!segment) return rem::push_error(HERE) << " zero segment size";
+    iovec iov{const_cast<uint8_t*>(data), size};
+    alignas(cmsghdr) char ctl[CMSG_SPACE(sizeof(uint16_t))] = {};
+    msghdr h{};
+    h.msg_iov     = &iov;
+    h.msg_iovlen  = 1;
+    h.msg_name    = const_cast<sockaddr_storage*>(to);
+    h.msg_namelen = to ? tolen : 0;
+    if(size > segment)
+    {
+        h.msg_control    = ctl;
+        h.msg_controllen = sizeof(ctl);
+        cmsghdr* c = CMSG_FIRSTHDR(&h);
+        c->cmsg_level = SOL_UDP;
+        c->cmsg_type  = UDP_SEGMENT;
+        c->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+        std::memcpy(CMSG_DATA(c), &segment, sizeof(segment));
+    }
+    auto r = ::sendmsg(m_fd, &h, MSG_DONTWAIT);
+    if(r >= 0) return static_cast<std::size_t>(r);
+    if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    if(size <= segment || (errno != EINVAL && errno != EIO && errno != ENOPROTOOPT))
+        return rem::push_error(HERE) << " sendmsg: " << std::strerror(errno);
+
+    // No GSO here: one datagram per segment.
+    datagram::batch b;
+    b.reserve(size / segment + 1);
+    for(std::size_t off = 0; off < size; off += segment)
+        b.push_back({const_cast<uint8_t*>(data) + off, std::min<std::size_t>(segment, size - off), to, tolen});
+    auto S = send(b.data(), b.size());
+    if(!S) return S;
+    std::size_t bytes = 0;
+    for(std::size_t x = 0; x < *S; x++) bytes += b[x].size;
+    return bytes;
+}
+
+}
@@ -0,0 +1,335 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+
+#include "iolistener/unix_socket.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+
+using namespace book;
+
+namespace io
+{
+
+
+unix_socket::unix_socket(object* parent, const std::string& ii, type t): object(parent,ii), m_type(t)
+{
+}
+
+unix_socket::unix_socket()
+{
+}
+
+unix_socket::~unix_socket()
+{
+    for(int d : m_in_fds) ::close(d);
+    // Registered: the listener drops the ifd with the fd.
+    if(m_listener && m_listener->query_fd(m_fd)) (void)m_listener->close_ifd(m_fd);
+    else if(m_fd >= 0) ::close(m_fd);
+    if(m_listening && !m_path.empty() && m_path[0] != '@') ::unlink(m_path.c_str());
+}
+
+
+int unix_socket::create()
+{
+    m_fd = ::socket(AF_UNIX, static_cast<int>(m_type) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_fd < 0) rem::push_error(HERE) << " socket(AF_UNIX): " << std::strerror(errno);
+    return m_fd;
+}
+
+
+void unix_socket::set_sockfd(int fd, type t)
+{
+    m_fd = fd;
+    m_type = t;
+}
+
+
+/*!
+ * \brief unix_socket::mkaddr fills \a addr from \a path - '@name' is the abstract namespace.
+ * \return the address length to give to bind/connect; 0 if the path does not fit.
+ */
+socklen_t unix_socket::mkaddr(const std::string& path, sockaddr_un& addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(addr.sun_path)) return 0;
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    if(path[0] == '@')
+    {
+        addr.sun_path[0] = '\0';
+        return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    }
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+
+
+expect<> unix_socket::bind(const std::string& path, int backlog)
+{
+    if(m_fd < 0 && create() < 0) return rem::push_error(HERE) << " no socket";
+    sockaddr_un a;
+    auto len = mkaddr(path, a);
+    if(!len) return rem::push_error(HERE) << " invalid unix socket path '" << path << "'";
+    if(path[0] != '@') ::unlink(path.c_str()); // stale socket file from a previous run.
+    if(::bind(m_fd, reinterpret_cast<sockaddr*>(&a), len) < 0)
+        return rem::push_error(HERE) << " bind(" << path << "): " << std::strerror(errno);
+    if(::listen(m_fd, backlog) < 0)
+        return rem::push_error(HERE) << " listen(" << path << "): " << std::strerror(errno);
+    m_path = path;
+    m_listening = true;
+    return rem::ok;
+}
+
+
+expect<> unix_socket::connect(const std::string& path)
+{
+    if(m_fd < 0 && create() < 0) return rem::push_error(HERE) << " no socket";
+    sockaddr_un a;
+    auto len = mkaddr(path, a);
+    if(!len) return rem::push_error(HERE) << " invalid unix socket path '" << path << "'";
+    // Local connect completes or fails at once, even on a non-blocking socket - except EAGAIN on a full backlog.
+    if(::connect(m_fd, reinterpret_cast<sockaddr*>(&a), len) < 0)
+        return rem::push_error(HERE) << " connect(" << path << "): " << std::strerror(errno);
+    m_path = path;
+    return rem::ok;
+}
+
+
+/*!
+ * \brief unix_socket::accept takes one pending connection.
+ * \return the new (non-blocking) descriptor, or -1 if none is pending.
+ */
+expect<int> unix_socket::accept()
+{
+    int fd = ::accept4(m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return -1;
+        return rem::push_error(HERE) << " accept: " << std::strerror(errno);
+    }
+    return fd;
+}
+
+
+expect<> unix_socket::pair(unix_socket& a, unix_socket& b, type t)
+{
+    int sv[2];
+    if(::socketpair(AF_UNIX, static_cast<int>(t) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) < 0)
+        return rem::push_error(HERE) << " socketpair: " << std::strerror(errno);
+    a.set_sockfd(sv[0], t);
+    b.set_sockfd(sv[1], t);
+    return rem::ok;
+}
+
+
+/*!
+ * \brief unix_socket::attach registers the socket into the listener. A seqpacket socket is a message descriptor (ifd::O_MSG).
+ * The first write_signal slot finishes the messages cut by a full socket.
+ */
+expect<> unix_socket::attach(listener& l, uint32_t opt_)
+{
+    if(m_fd < 0) return rem::push_error(HERE) << " no socket";
+    if(m_type == type::seqpacket) opt_ |= ifd::O_MSG;
+    auto R = l.add_ifd(m_fd, opt_ | ifd::O_WRITE);
+    if(!R) return R;
+    m_ifd = l.query_fd(m_fd);
+    m_ifd->write_signal().connect(this, &unix_socket::writable);
+    m_listener = &l;
+    return rem::ok;
+}
+
+
+namespace
+{
+/*!
+ * \brief as much of \a len bytes as the socket takes or has, without blocking.
+ * \return the bytes moved; closed if the peer closed.
+ */
+expect<std::size_t> transfer(int fd, char* p, std::size_t len, bool out)
+{
+    std::size_t done = 0;
+    while(done < len)
+    {
+        auto r = out ? ::send(fd, p + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT) : ::recv(fd, p + done, len - done, MSG_DONTWAIT);
+        if(r > 0)
+        {
+            done += static_cast<std::size_t>(r);
+            continue;
+        }
+        if(!r) return unix_socket::closed;
+        if(errno == EINTR) continue;
+        if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return rem::push_error(HERE) << (out ? " send: " : " recv: ") << std::strerror(errno);
+    }
+    return done;
+}
+}
+
+
+/*!
+ * \brief unix_socket::flush sends what is left of a message cut by a full socket - the write_signal does it once attached.
+ * \return the bytes still pending.
+ */
+expect<std::size_t> unix_socket::flush()
+{
+    if(m_out.empty()) return 0;
+    auto R = transfer(m_fd, m_out.data(), m_out.size(), true);
+    if(!R) return R;
+    m_out.erase(m_out.begin(), m_out.begin() + static_cast<std::ptrdiff_t>(*R));
+    if(m_listener && m_ifd) (void)m_listener->want_write(m_fd, !m_out.empty());
+    return m_out.size();
+}
+
+
+expect<> unix_socket::writable(ifd&)
+{
+    auto R = flush();
+    if(!R) return R();
+    return rem::ok;
+}
+
+
+/*!
+ * \brief unix_socket::send_fds passes \a n open descriptors to the peer, max_fds per message.
+ *
+ * Without \a data, each message carries one zero byte - a stream socket cannot carry ancillary data alone. With \a data,
+ * the descriptors and the payload are one message: at most max_fds of them. A payload cut by a stream socket is kept
+ * and finished later (see flush(), pending()); nothing more is sent until then. The descriptors stay open here: close
+ * them once sent if they are handed off.
+ * \return number of descriptors sent; less than n if the socket buffer is full.
+ */
+expect<std::size_t> unix_socket::send_fds(const int* fds, std::size_t n, const void* data, std::size_t size)
+{
+    if(data && size && n > max_fds)
+        return rem::push_error(HERE) << " " << n << " descriptors with a payload: at most " << max_fds << " (one message)";
+    // The previous message first: the peer reads the stream in order.
+    auto F = flush();
+    if(!F) return F;
+    if(*F) return 0;
+    std::vector<char> ctl(CMSG_SPACE(sizeof(int) * max_fds));
+    char dummy = 0;
+    std::size_t sent = 0;
+    do{
+        auto chunk = std::min(n - sent, max_fds);
+        iovec iov = (data && size) ? iovec{const_cast<void*>(data), size} : iovec{&dummy, 1};
+        msghdr h{};
+        h.msg_iov    = &iov;
+        h.msg_iovlen = 1;
+        if(chunk)
+        {
+            h.msg_control    = ctl.data();
+            h.msg_controllen = CMSG_SPACE(sizeof(int) * chunk);
+            cmsghdr* c = CMSG_FIRSTHDR(&h);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type  = SCM_RIGHTS;
+            c->cmsg_len   = CMSG_LEN(sizeof(int) * chunk);
+            std::memcpy(CMSG_DATA(c), fds + sent, sizeof(int) * chunk);
+        }
+        auto r = ::sendmsg(m_fd, &h, MSG_NOSIGNAL);
+        if(r < 0)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return rem::push_error(HERE) << " sendmsg(SCM_RIGHTS): " << std::strerror(errno);
+        }
+        // The descriptors went with the first bytes; the rest of a cut payload goes out later.
+        sent += chunk;
+        if(static_cast<std::size_t>(r) < iov.iov_len)
+        {
+            auto* p = static_cast<char*>(iov.iov_base);
+            m_out.assign(p + r, p + iov.iov_len);
+            if(m_listener && m_ifd) (void)m_listener->want_write(m_fd, true);
+            break;
+        }
+    }while(sent < n);
+    return sent;
+}
+
+
+/*!
+ * \brief unix_socket::recv_fds receives one message and appends the descriptors it carries to \a fds (close-on-exec set).
+ *
+ * \a data receives the payload; without it the one byte of send_fds() is consumed. Use the same \a size as the sender:
+ * a payload cut by a stream socket is kept, with its descriptors, until the rest comes in - a later call returns it.
+ * \return number of payload bytes received - 0 with no descriptor: no whole message pending; closed: the peer closed.
+ */
+expect<std::size_t> unix_socket::recv_fds(std::vector<int>& fds, void* data, std::size_t size)
+{
+    if(m_in_size)
+    {
+        auto at = m_in.size();
+        m_in.resize(m_in_size);
+        auto R = transfer(m_fd, m_in.data() + at, m_in_size - at, false);
+        if(!R || *R == closed)
+        {
+            for(int d : m_in_fds) ::close(d);
+            m_in_fds.clear();
+            m_in.clear();
+            m_in_size = 0;
+            if(!R) return R;
+            return rem::push_error(HERE) << " peer closed in the middle of a message";
+        }
+        m_in.resize(at + *R);
+        if(m_in.size() < m_in_size) return 0;
+        auto n = std::min(size, m_in_size);
+        std::memcpy(data, m_in.data(), n);
+        fds.insert(fds.end(), m_in_fds.begin(), m_in_fds.end());
+        m_in_fds.clear();
+        m_in.clear();
+        m_in_size = 0;
+        return n;
+    }
+
+    auto base = fds.size();
+    std::vector<char> ctl(CMSG_SPACE(sizeof(int) * max_fds));
+    char dummy;
+    iovec iov = (data && size) ? iovec{data, size} : iovec{&dummy, 1};
+    msghdr h{};
+    h.msg_iov        = &iov;
+    h.msg_iovlen     = 1;
+    h.msg_control    = ctl.data();
+    h.msg_controllen = ctl.size();
+    auto r = ::recvmsg(m_fd, &h, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if(r < 0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        return rem::push_error(HERE) << " recvmsg(SCM_RIGHTS): " << std::strerror(errno);
+    }
+    if(!r) return closed; // send_fds() never sends an empty message.
+    for(cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c))
+    {
+        if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        auto count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        auto at = fds.size();
+        fds.resize(at + count);
+        std::memcpy(fds.data() + at, CMSG_DATA(c), count * sizeof(int));
+    }
+    if(h.msg_flags & MSG_CTRUNC)
+        rem::push_warning(HERE) << " descriptors truncated by the kernel (RLIMIT_NOFILE ?)";
+    if(!(data && size)) return 0;
+    if(m_type == type::stream && static_cast<std::size_t>(r) < size)
+    {
+        // Cut: kept with its descriptors until the rest comes in - maybe already there.
+        auto* p = static_cast<char*>(data);
+        m_in.assign(p, p + r);
+        m_in_size = size;
+        m_in_fds.assign(fds.begin() + static_cast<std::ptrdiff_t>(base), fds.end());
+        fds.resize(base);
+        return recv_fds(fds, data, size);
+    }
+    return static_cast<std::size_t>(r);
+}
+
+}
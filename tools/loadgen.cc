@@ -0,0 +1,491 @@
+/***************************************************************************
+ *   Copyright (C) 1965/1987/2023 by Serge Lussier                         *
+ *   serge.lussier@oldlonecoder.club                                       *
+ *                                                                         *
+ *                                                                         *
+ *   Unless otherwise specified, all code in this project is written       *
+ *   by the author (Serge Lussier)                                         *
+ *   and no one else then not even {copilot, chatgpt, or any other AI}     *
+ *   --------------------------------------------------------------------- *
+ *   Copyrights from authors other than Serge Lussier also apply here      *
+ ***************************************************************************/
+
+
+/*!
+ * iolistener_loadgen - tcp request/response load generator on top of io::listener.
+ *
+ *     iolistener_loadgen [options]
+ *        --connect host:port   target server (echo protocol: each request of --size bytes gets --size bytes back)
+ *        --echo                start a local echo server and target it (default when --connect is not given)
+ *        --connections N       concurrent connections (100)
+ *        --size B              request (and response) size in bytes (64)
+ *        --depth D             requests in flight per connection - pipelining (1)
+ *        --rate R              open loop: R requests/s in total, sent on schedule; 0 = closed loop (0)
+ *        --duration S          measured seconds (10)
+ *        --warmup S            seconds not measured before that (1)
+ *
+ * Open loop: each request has an intended send time from the schedule; its latency runs from that time, not from the
+ * time it could actually be sent - a stalled server is charged for the requests it prevented (coordinated omission).
+ * The requests scheduled on a connection that closed, or in flight on it, are reported as lost.
+ * Closed loop: the raw latencies are reported, and corrected the HdrHistogram way with the median as expected interval.
+ */
+
+#include "iolistener/listener.h"
+#include "iolistener/tcp_socket.h"
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace book;
+
+namespace
+{
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/*!
+ * \brief histogram - log-linear latency histogram: 64 linear sub-buckets per power of two (~1.5% precision), in ns.
+ */
+struct histogram
+{
+    static constexpr std::size_t sub = 64;
+    std::vector<uint64_t> counts = std::vector<uint64_t>(sub * 60, 0);
+    uint64_t total = 0;
+    uint64_t max = 0;
+
+    static std::size_t index(uint64_t v)
+    {
+        if(v < sub) return v;
+        int msb = 63 - __builtin_clzll(v);
+        return (msb - 5) * sub + ((v >> (msb - 6)) & (sub - 1));
+    }
+
+    static uint64_t value(std::size_t i)
+    {
+        if(i < sub) return i;
+        auto msb = i / sub + 5;
+        return ((i % sub) + sub) << (msb - 6);
+    }
+
+    void record(uint64_t v, uint64_t n = 1)
+    {
+        counts[index(v)] += n;
+        total += n;
+        if(v > max) max = v;
+    }
+
+    uint64_t percentile(double p) const
+    {
+        if(!total) return 0;
+        auto rank = static_cast<uint64_t>(std::ceil(p * total));
+        if(!rank) rank = 1;
+        uint64_t seen = 0;
+        for(std::size_t i = 0; i < counts.size(); i++)
+        {
+            seen += counts[i];
+            if(seen >= rank) return std::min(value(i), max);
+        }
+        return max;
+    }
+
+    /*!
+     * \brief corrected adds, for each sample larger than \a interval, the samples the stalled sender would have had.
+     */
+    histogram corrected(uint64_t interval) const
+    {
+        histogram h;
+        for(std::size_t i = 0; i < counts.size(); i++)
+        {
+            if(!counts[i]) continue;
+            auto v = value(i);
+            h.record(v, counts[i]);
+            if(!interval) continue;
+            for(uint64_t m = v > interval ? v - interval : 0; m >= interval; m -= interval)
+                h.record(m, counts[i]);
+        }
+        h.max = std::max(h.max, max);
+        return h;
+    }
+};
+
+
+struct options
+{
+    std::string target;
+    bool        echo = false;
+    std::size_t connections = 100;
+    std::size_t size = 64;
+    std::size_t depth = 1;
+    double      rate = 0;
+    double      duration = 10;
+    double      warmup = 1;
+};
+
+
+/*!
+ * \brief echo_server - local target: echoes what it reads; output that does not fit the socket is kept and retried.
+ */
+struct echo_server
+{
+    io::listener* l = nullptr;
+    int server = -1;
+    int stop = -1;                      ///< eventfd: main asks the server loop to end - shutdown() from its own thread.
+    std::vector<std::string> pending;   ///< by fd.
+    std::vector<int> backlog;           ///< fds with pending output.
+    char buf[64 * 1024];
+
+    void flush(int fd)
+    {
+        auto& p = pending[fd];
+        while(!p.empty())
+        {
+            auto n = ::write(fd, p.data(), p.size());
+            if(n <= 0) return;
+            p.erase(0, n);
+        }
+    }
+
+    void flush_backlog()
+    {
+        std::size_t k = 0;
+        for(int fd : backlog)
+        {
+            flush(fd);
+            if(!pending[fd].empty()) backlog[k++] = fd;
+        }
+        backlog.resize(k);
+    }
+
+    rem::code on_read(io::ifd& f)
+    {
+        if(f.fd == stop) return rem::end;
+        if(f.fd == server)
+        {
+            int c;
+            while((c = ::accept4(server, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                int one = 1;
+                setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if(static_cast<std::size_t>(c) >= pending.size()) pending.resize(c + 1);
+                (void)l->add_ifd(c, io::ifd::O_READ);
+            }
+            return rem::ok;
+        }
+        auto n = ::read(f.fd, buf, sizeof(buf));
+        if(n <= 0) return rem::ok;
+        auto& p = pending[f.fd];
+        bool was_empty = p.empty();
+        if(was_empty)
+        {
+            auto w = ::write(f.fd, buf, n);
+            if(w < 0) w = 0;
+            if(w < n) p.append(buf + w, n - w);
+        }
+        else
+            p.append(buf, n);
+        if(was_empty && !p.empty()) backlog.push_back(f.fd);
+        flush_backlog();
+        return rem::ok;
+    }
+    rem::code on_write(io::ifd&) { return rem::ok; }
+    void on_close(io::ifd& f)
+    {
+        if(static_cast<std::size_t>(f.fd) < pending.size()) pending[f.fd].clear();
+        (void)l->close_ifd(f.fd);
+    }
+    void on_idle() { flush_backlog(); }
+};
+
+
+/*!
+ * \brief driver - the client side: one listener for all the connections and a timerfd tick for the schedule.
+ */
+struct driver
+{
+    struct connection
+    {
+        int fd = -1;
+        bool open = false;
+        std::deque<uint64_t> queued;      ///< intended send times not sent yet (open loop).
+        std::deque<uint64_t> intended;    ///< in flight: intended send times.
+        std::deque<uint64_t> sent;        ///< in flight: actual send times.
+        std::size_t out = 0;              ///< bytes of the current request still to write.
+        std::size_t in = 0;               ///< bytes of the current response received.
+    };
+
+    io::listener* l = nullptr;
+    options opt;
+    int tick = -1;
+    std::vector<connection> conns;
+    std::vector<connection*> by_fd;
+    std::vector<char> request;
+    std::vector<char> scratch = std::vector<char>(256 * 1024);
+
+    uint64_t start = 0, measure = 0, end = 0;
+    uint64_t issued = 0;                  ///< open loop: requests scheduled so far.
+    uint64_t completed = 0, errors = 0, bytes = 0;
+    uint64_t lost = 0;                    ///< measured requests scheduled or in flight on a closed connection.
+    histogram raw, from_intended;
+
+    void lose(uint64_t at) { if(at >= measure) ++lost; }
+
+    connection* query(int fd) { return static_cast<std::size_t>(fd) < by_fd.size() ? by_fd[fd] : nullptr; }
+
+    /*!
+     * \brief pump writes what the connection may send: the partial request first, then new ones up to the depth.
+     */
+    void pump(connection& c, uint64_t now)
+    {
+        if(!c.open) return;
+        while(true)
+        {
+            if(!c.out)
+            {
+                if(c.intended.size() >= opt.depth) return;
+                uint64_t at;
+                if(opt.rate > 0)
+                {
+                    if(c.queued.empty()) return;
+                    at = c.queued.front();
+                    c.queued.pop_front();
+                }
+                else
+                    at = now;
+                c.intended.push_back(at);
+                c.sent.push_back(now);
+                c.out = opt.size;
+            }
+            auto n = ::send(c.fd, request.data() + (opt.size - c.out), c.out, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if(n <= 0) return; // socket full or still connecting: next tick.
+            c.out -= n;
+            if(c.out) return;
+        }
+    }
+
+    void on_tick(uint64_t now)
+    {
+        uint64_t expirations;
+        (void)::read(tick, &expirations, sizeof(expirations));
+        if(now >= end)
+        {
+            l->shutdown();
+            return;
+        }
+        if(opt.rate > 0)
+        {
+            auto due = static_cast<uint64_t>((now - start) * opt.rate / 1e9);
+            for(; issued < due; issued++)
+            {
+                auto& c = conns[issued % conns.size()];
+                auto at = start + static_cast<uint64_t>(issued * 1e9 / opt.rate);
+                if(c.open) c.queued.push_back(at);
+                else lose(at);
+            }
+        }
+        for(auto& c : conns) pump(c, now);
+    }
+
+    rem::code on_read(io::ifd& f)
+    {
+        auto now = now_ns();
+        if(f.fd == tick)
+        {
+            on_tick(now);
+            return rem::ok;
+        }
+        auto* c = query(f.fd);
+        if(!c) return rem::ok;
+        auto n = ::recv(f.fd, scratch.data(), scratch.size(), MSG_DONTWAIT);
+        if(n <= 0) return rem::ok;
+        c->in += n;
+        while(c->in >= opt.size && !c->intended.empty())
+        {
+            c->in -= opt.size;
+            if(now >= measure)
+            {
+                raw.record(now - c->sent.front());
+                from_intended.record(now - c->intended.front());
+                ++completed;
+                bytes += opt.size;
+            }
+            c->intended.pop_front();
+            c->sent.pop_front();
+        }
+        pump(*c, now);
+        return rem::ok;
+    }
+    rem::code on_write(io::ifd&) { return rem::ok; }
+    void on_close(io::ifd& f)
+    {
+        if(auto* c = query(f.fd))
+        {
+            c->open = false;
+            by_fd[f.fd] = nullptr;
+            ++errors;
+            for(auto at : c->queued) lose(at);
+            for(auto at : c->intended) lose(at);
+            c->queued.clear();
+            c->intended.clear();
+            c->sent.clear();
+        }
+        (void)l->close_ifd(f.fd);
+    }
+};
+
+
+int usage()
+{
+    std::cerr << "usage: iolistener_loadgen [--connect host:port | --echo] [--connections N] [--size B] [--depth D]\n"
+                 "                          [--rate R] [--duration S] [--warmup S]\n";
+    return 1;
+}
+
+
+void report(const char* what, const histogram& h)
+{
+    std::cout << what << "  p50 " << h.percentile(0.50) / 1000.0 << "  p90 " << h.percentile(0.90) / 1000.0
+              << "  p99 " << h.percentile(0.99) / 1000.0 << "  p99.9 " << h.percentile(0.999) / 1000.0
+              << "  p99.99 " << h.percentile(0.9999) / 1000.0 << "  max " << h.max / 1000.0 << "  (usec)\n";
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for(int a = 1; a < argc; a++)
+    {
+        std::string k = argv[a];
+        auto next = [&]() -> const char* { return a + 1 < argc ? argv[++a] : nullptr; };
+        const char* v = nullptr;
+        if(k == "--echo") { opt.echo = true; continue; }
+        if(!(v = next())) return usage();
+        if(k == "--connect") opt.target = v;
+        else if(k == "--connections") opt.connections = std::strtoul(v, nullptr, 10);
+        else if(k == "--size") opt.size = std::strtoul(v, nullptr, 10);
+        else if(k == "--depth") opt.depth = std::strtoul(v, nullptr, 10);
+        else if(k == "--rate") opt.rate = std::strtod(v, nullptr);
+        else if(k == "--duration") opt.duration = std::strtod(v, nullptr);
+        else if(k == "--warmup") opt.warmup = std::strtod(v, nullptr);
+        else return usage();
+    }
+    if(opt.target.empty()) opt.echo = true;
+    if(!opt.connections || !opt.size || !opt.depth) return usage();
+
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rlim_t want = 2 * opt.connections + 64; rl.rlim_cur < want)
+    {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, want);
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // Local echo server, in its own listener thread:
+    io::listener server_listener(nullptr, 1);
+    echo_server echo;
+    std::thread server_thread;
+    if(opt.echo)
+    {
+        echo.l = &server_listener;
+        echo.server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(a);
+        if(::bind(echo.server, reinterpret_cast<sockaddr*>(&a), len) < 0 || ::listen(echo.server, SOMAXCONN) < 0)
+        {
+            std::cerr << "echo server: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+        getsockname(echo.server, reinterpret_cast<sockaddr*>(&a), &len);
+        opt.target = "127.0.0.1:" + std::to_string(ntohs(a.sin_port));
+        (void)server_listener.add_ifd(echo.server, io::ifd::O_READ | io::ifd::O_MSG);
+        echo.stop = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        (void)server_listener.add_ifd(echo.stop, io::ifd::O_READ | io::ifd::O_MSG);
+    }
+
+    sockaddr_in addr{};
+    int addr_len = sizeof(addr);
+    if(io::tcp_socket::mkaddr(&addr, &addr_len, opt.target.c_str(), "tcp") < 0)
+    {
+        std::cerr << "invalid address " << opt.target << '\n';
+        return 1;
+    }
+    // Started once nothing can fail before the join below.
+    if(opt.echo)
+    {
+        server_thread = std::thread([&]{ (void)server_listener.run(echo); });
+        std::cout << "echo server on " << opt.target << '\n';
+    }
+
+    io::listener l(nullptr, -1);
+    driver d;
+    d.l = &l;
+    d.opt = opt;
+    d.request.assign(opt.size, 'q');
+    d.conns.resize(opt.connections);
+    for(auto& c : d.conns)
+    {
+        c.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(c.fd < 0) break;
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if(::connect(c.fd, reinterpret_cast<sockaddr*>(&addr), addr_len) < 0 && errno != EINPROGRESS)
+        {
+            ::close(c.fd);
+            ++d.errors;
+            continue;
+        }
+        c.open = true;
+        if(static_cast<std::size_t>(c.fd) >= d.by_fd.size()) d.by_fd.resize(c.fd + 1, nullptr);
+        d.by_fd[c.fd] = &c;
+        (void)l.add_ifd(c.fd, io::ifd::O_READ);
+    }
+
+    // 100 usec schedule tick - open loop resolution, and retry of the sends the socket did not take:
+    d.tick = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec its{{0, 100000}, {0, 100000}};
+    timerfd_settime(d.tick, 0, &its, nullptr);
+    (void)l.add_ifd(d.tick, io::ifd::O_READ | io::ifd::O_MSG);
+
+    d.start   = now_ns();
+    d.measure = d.start + static_cast<uint64_t>(opt.warmup * 1e9);
+    d.end     = d.measure + static_cast<uint64_t>(opt.duration * 1e9);
+    std::cout << opt.connections << " connections to " << opt.target << ", " << opt.size << " bytes, depth " << opt.depth
+              << ", " << (opt.rate > 0 ? std::to_string(static_cast<uint64_t>(opt.rate)) + " req/s open loop" : std::string("closed loop"))
+              << ", " << opt.duration << " s (+" << opt.warmup << " s warmup)\n";
+    (void)l.run(d);
+    auto elapsed = (now_ns() - d.measure) / 1e9;
+
+    if(opt.echo)
+    {
+        (void)::eventfd_write(echo.stop, 1);
+        server_thread.join();
+        ::close(echo.stop);
+    }
+
+    std::cout << d.completed << " requests, " << static_cast<uint64_t>(d.completed / elapsed) << " req/s, "
+              << d.bytes / elapsed / 1e6 << " MB/s, " << d.errors << " connection errors, " << d.lost
+              << " requests lost on closed connections\n";
+    report("latency (from send)      ", d.raw);
+    if(opt.rate > 0)
+        report("latency (from schedule)  ", d.from_intended);
+    else
+        report("latency (CO corrected)   ", d.raw.corrected(d.raw.percentile(0.5)));
+    return 0;
+}